@@ -1,5 +1,68 @@
 #include "CMD.hpp"
 #include "Shell.hpp"
+#include <cerrno>
+#include <cstdlib>
+
+namespace
+{
+struct ResourceInfo
+{
+    char m_Flag;
+    int m_Resource;
+    rlim_t m_Unit; // the shown/given values are in multiples of m_Unit
+    const char *m_Description;
+};
+
+const ResourceInfo RESOURCES[] = {
+    {'c', RLIMIT_CORE, 1024, "core file size (kbytes)"},
+    {'d', RLIMIT_DATA, 1024, "data seg size (kbytes)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (kbytes)"},
+    {'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)"},
+    {'m', RLIMIT_RSS, 1024, "max memory size (kbytes)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'s', RLIMIT_STACK, 1024, "stack size (kbytes)"},
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'u', RLIMIT_NPROC, 1, "max user processes"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (kbytes)"},
+};
+
+void PrintLimit(const ResourceInfo &info, bool bHard, bool bWithDescription)
+{
+    struct rlimit rlim;
+    getrlimit(info.m_Resource, &rlim);
+    const rlim_t value = bHard ? rlim.rlim_max : rlim.rlim_cur;
+
+    if (bWithDescription)
+        printf("%-28s(-%c) ", info.m_Description, info.m_Flag);
+    if (value == RLIM_INFINITY)
+        printf("unlimited\n");
+    else
+        printf("%lu\n", static_cast<unsigned long>(value / info.m_Unit));
+}
+
+// parses a limit given in multiples of info.m_Unit, rejects values that don't fit in rlim_t
+bool ParseLimit(const std::string &str, const ResourceInfo &info, rlim_t &limit)
+{
+    if (str == "unlimited")
+    {
+        limit = RLIM_INFINITY;
+        return true;
+    }
+
+    // strtoull would also accept leading spaces and a sign
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long number = strtoull(str.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || number > (RLIM_INFINITY - 1) / info.m_Unit)
+        return false;
+
+    limit = static_cast<rlim_t>(number) * info.m_Unit;
+    return true;
+}
+} // namespace
 
 namespace CMD
 {
@@ -26,12 +89,52 @@ void cd(Shell &shell, const std::vector<std::string> &args)
     }
 }
 
+void pwd(Shell &shell, const std::vector<std::string> &args)
+{
+    std::cout << shell.GetCurrWorkingDir() << '\n';
+}
+
+void echo(Shell &shell, const std::vector<std::string> &args)
+{
+    size_t first = 1;
+    bool bNewLine = true;
+    if (args.size() > 1 && args[1] == "-n")
+    {
+        bNewLine = false;
+        first = 2;
+    }
+
+    for (size_t i = first; i < args.size(); ++i)
+    {
+        if (i != first)
+            std::cout << ' ';
+        std::cout << args[i];
+    }
+    if (bNewLine)
+        std::cout << '\n';
+}
+
 void jobs(Shell &shell, const std::vector<std::string> &args)
 {
-    const auto Jobs = shell.GetCurrentJobs();
+    const auto &Jobs = shell.GetCurrentJobs();
+    if (args.size() > 1 && args[1] == "--json")
+    {
+        // same format as the cshell-jobs reader uses for the status page
+        JobStatusSnapshot snapshot;
+        snapshot.m_ShellPid = getpid();
+        for (size_t idx = 0; idx < Jobs.size(); ++idx)
+        {
+            snapshot.m_Jobs.push_back(JobStatusPage::MakeEntry(Jobs[idx], idx));
+        }
+        fflush(stdout);
+        JobStatusPage::PrintJson(stdout, snapshot);
+        return;
+    }
+
+    const bool bPrintCPUs = (args.size() > 1 && args[1] == "-l");
     for (size_t idx = 0; idx < Jobs.size(); ++idx)
     {
-        shell.PrintJobStatus(idx);
+        shell.PrintJobStatus(idx, true, bPrintCPUs);
     }
 }
 
@@ -70,5 +173,185 @@ bool disown(Shell &shell, const std::vector<std::string> &args)
     return true;
 }
 
+bool stats(Shell &shell, const std::vector<std::string> &args)
+{
+    size_t count = 10;
+    auto order = JobStats::SortOrder::SLOWEST;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-f")
+        {
+            order = JobStats::SortOrder::MOST_FREQUENT;
+        }
+        else if (args[i] == "-n" && i + 1 < args.size())
+        {
+            const auto &count_str = args[++i];
+            if (count_str.empty() || count_str.find_first_not_of("0123456789") != std::string::npos)
+                return false;
+            std::stringstream ss(count_str);
+            ss >> count;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (!shell.GetJobStats().IsOpen())
+    {
+        std::cout << "No stats available\n";
+        return true;
+    }
+    shell.GetJobStats().Print(count, order);
+    return true;
+}
+
+bool ulimit(Shell &shell, const std::vector<std::string> &args)
+{
+    bool bSoft = false, bHard = false, bAll = false;
+    const ResourceInfo *info = &RESOURCES[2]; // -f by default like other shells
+    const std::string *value = nullptr;
+
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        const auto &arg = args[i];
+        if (arg[0] != '-')
+        {
+            if (value || i != args.size() - 1)
+                return false; // the value must be the last argument
+            value = &arg;
+            continue;
+        }
+
+        for (size_t c = 1; c < arg.size(); ++c)
+        {
+            if (arg[c] == 'S')
+                bSoft = true;
+            else if (arg[c] == 'H')
+                bHard = true;
+            else if (arg[c] == 'a')
+                bAll = true;
+            else
+            {
+                auto it = std::find_if(std::begin(RESOURCES), std::end(RESOURCES), [&](const ResourceInfo &resource) {
+                    return resource.m_Flag == arg[c];
+                });
+                if (it == std::end(RESOURCES))
+                    return false;
+                info = &*it;
+            }
+        }
+    }
+
+    if (bAll)
+    {
+        if (value)
+            return false;
+        for (const auto &resource : RESOURCES)
+            PrintLimit(resource, bHard && !bSoft, true);
+        return true;
+    }
+
+    if (!value)
+    {
+        PrintLimit(*info, bHard && !bSoft, false);
+        return true;
+    }
+
+    rlim_t newLimit;
+    if (!ParseLimit(*value, *info, newLimit))
+        return false;
+
+    // set both limits unless one of them was asked for explicitly
+    if (!bSoft && !bHard)
+        bSoft = bHard = true;
+
+    struct rlimit rlim;
+    getrlimit(info->m_Resource, &rlim);
+    if (bSoft)
+        rlim.rlim_cur = newLimit;
+    if (bHard)
+        rlim.rlim_max = newLimit;
+    if (setrlimit(info->m_Resource, &rlim) != 0)
+    {
+        perror(shell.GetName().c_str());
+    }
+    return true;
+}
+
+bool spread(Shell &shell, const std::vector<std::string> &args)
+{
+    if (args.size() == 1)
+    {
+        switch (shell.GetSpreadMode())
+        {
+        case SpreadMode::OFF:
+            std::cout << "off\n";
+            break;
+        case SpreadMode::CPU:
+            std::cout << "cpu\n";
+            break;
+        case SpreadMode::NUMA:
+            std::cout << "numa\n";
+            break;
+        }
+        return true;
+    }
+
+    if (args.size() > 2)
+        return false;
+
+    if (args[1] == "off")
+        shell.SetSpreadMode(SpreadMode::OFF);
+    else if (args[1] == "cpu")
+        shell.SetSpreadMode(SpreadMode::CPU);
+    else if (args[1] == "numa")
+        shell.SetSpreadMode(SpreadMode::NUMA);
+    else
+        return false;
+    return true;
+}
+
+bool export_(Shell &shell, const std::vector<std::string> &args)
+{
+    auto &variables = shell.GetVariables();
+    if (args.size() == 1)
+    {
+        variables.PrintExported();
+        return true;
+    }
+
+    bool bAllValid = true;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        const auto separator = args[i].find('=');
+        const std::string name = args[i].substr(0, separator);
+        if (!Variables::IsValidName(name))
+        {
+            bAllValid = false;
+            continue;
+        }
+        if (separator != std::string::npos)
+            variables.Set(name, args[i].substr(separator + 1));
+        variables.Export(name);
+    }
+    return bAllValid;
+}
+
+bool unset(Shell &shell, const std::vector<std::string> &args)
+{
+    bool bAllValid = true;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (!Variables::IsValidName(args[i]))
+        {
+            bAllValid = false;
+            continue;
+        }
+        shell.GetVariables().Unset(args[i]);
+    }
+    return bAllValid;
+}
+
 
 } // namespace CMD
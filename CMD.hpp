@@ -8,7 +8,9 @@ class Shell; // forward declaration
 namespace CMD
 {
 void cd(Shell &shell, const std::vector<std::string> &args);
-void jobs(Shell &shell, const std::vector<std::string> &args);
+void pwd(Shell &shell, const std::vector<std::string> &args);
+void echo(Shell &shell, const std::vector<std::string> &args); // -n omits the trailing newline
+void jobs(Shell &shell, const std::vector<std::string> &args); // -l also shows the cpus each job is bound to, --json prints JSON
 
 /*
     the following functions:
@@ -19,4 +21,23 @@ bool bg(Shell &shell, const std::vector<std::string> &args);
 bool fg(Shell &shell, const std::vector<std::string> &args);
 bool disown(Shell &shell, const std::vector<std::string> &args);
 
+// prints the top slowest (or most frequent with -f) commands recorded in the stats file
+// returns false if there was a syntax error
+bool stats(Shell &shell, const std::vector<std::string> &args);
+
+// prints or sets resource limits of the shell which are inherited by the jobs it launches
+// returns false if there was a syntax error
+bool ulimit(Shell &shell, const std::vector<std::string> &args);
+
+// prints or sets how background jobs are spread across cpus (off, cpu, numa)
+// returns false if there was a syntax error
+bool spread(Shell &shell, const std::vector<std::string> &args);
+
+// sets and exports NAME=value args, marks NAME args as exported, prints the exported variables without args
+// returns false if a name isn't a valid identifier
+bool export_(Shell &shell, const std::vector<std::string> &args); // export is a reserved keyword
+
+// returns false if a name isn't a valid identifier
+bool unset(Shell &shell, const std::vector<std::string> &args);
+
 } // namespace CMD
@@ -1,6 +1,9 @@
 #pragma once
 #include <iostream>
+#include <chrono>
+#include <cstring>
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <string>
 
@@ -23,10 +26,17 @@ class Job
     JobStatus m_Status;
     ExecutionType m_ExecType;
     pid_t m_Pid;
+    std::chrono::steady_clock::time_point m_StartTime; // used to compute wall time of the job once it's reaped
+    std::chrono::system_clock::time_point m_StartRealTime;
+    struct rusage m_Usage; // resource usage as of the latest status change
 
 public:
     Job(const std::string &name, JobStatus status, ExecutionType execType, pid_t pid)
-        : m_Name(name), m_Status(status), m_ExecType(execType), m_Pid(pid) {}
+        : m_Name(name), m_Status(status), m_ExecType(execType), m_Pid(pid),
+          m_StartTime(std::chrono::steady_clock::now()), m_StartRealTime(std::chrono::system_clock::now())
+    {
+        memset(&m_Usage, 0, sizeof(m_Usage));
+    }
 
     void SetExecType(ExecutionType execType)
     {
@@ -58,9 +68,34 @@ public:
         return m_Name;
     }
 
+    std::chrono::steady_clock::time_point GetStartTime() const
+    {
+        return m_StartTime;
+    }
+
+    std::chrono::system_clock::time_point GetStartRealTime() const
+    {
+        return m_StartRealTime;
+    }
+
+    void SetUsage(const struct rusage &usage)
+    {
+        m_Usage = usage;
+    }
+
+    const struct rusage &GetUsage() const
+    {
+        return m_Usage;
+    }
+
     const char *GetStatusString() const
     {
-        switch (m_Status)
+        return GetStatusString(m_Status);
+    }
+
+    static const char *GetStatusString(JobStatus status)
+    {
+        switch (status)
         {
         case JobStatus::STATUS_RUNNING:
             return "Running";
@@ -0,0 +1,291 @@
+#include "JobStats.hpp"
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sched.h>
+
+namespace
+{
+// FNV-1a, never returns 0 or 1 since those mark free and claimed slots
+uint64_t HashName(const char *name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *name; ++name)
+    {
+        hash ^= static_cast<unsigned char>(*name);
+        hash *= 1099511628211ULL;
+    }
+    return hash > 1 ? hash : hash + 2;
+}
+
+uint64_t GetTotalCount(const JobStats::Histogram &histogram)
+{
+    uint64_t total = 0;
+    for (int idx = 0; idx < JobStats::BUCKET_COUNT; ++idx)
+        total += __atomic_load_n(&histogram.m_Buckets[idx], __ATOMIC_RELAXED);
+    return total;
+}
+
+// formats a duration given in microseconds into a short human readable string
+std::string FormatDuration(uint64_t us)
+{
+    char buffer[32];
+    if (us < 1000)
+        snprintf(buffer, sizeof(buffer), "%luus", static_cast<unsigned long>(us));
+    else if (us < 1000 * 1000)
+        snprintf(buffer, sizeof(buffer), "%.1fms", us / 1000.0);
+    else
+        snprintf(buffer, sizeof(buffer), "%.2fs", us / 1000000.0);
+    return buffer;
+}
+} // namespace
+
+JobStats::~JobStats()
+{
+    if (m_File)
+        munmap(m_File, sizeof(File));
+}
+
+bool JobStats::IsValidFile(int fd, off_t size)
+{
+    if (size != sizeof(File))
+        return false;
+
+    Header header;
+    return pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+           header.m_Magic == FILE_MAGIC && header.m_Version == FILE_VERSION &&
+           header.m_EntryCount == MAX_ENTRIES && header.m_BucketCount == BUCKET_COUNT;
+}
+
+bool JobStats::InitFile(int fd)
+{
+    // ftruncate zero-fills the file which leaves all slots free, so we only have to write the header
+    Header header;
+    header.m_Magic = FILE_MAGIC;
+    header.m_Version = FILE_VERSION;
+    header.m_EntryCount = MAX_ENTRIES;
+    header.m_BucketCount = BUCKET_COUNT;
+    return ftruncate(fd, sizeof(File)) == 0 && pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+}
+
+bool JobStats::Open(const std::string &path)
+{
+    /*
+        other shells may have the file mapped and be recording into it from their SIGCHLD handler,
+        so a live file is never truncated (that would SIGBUS them):
+        - the header of an empty file is written while holding an exclusive flock
+        - an incompatible file is replaced by a new one with rename, old mappings keep the old file
+        the retries handle the file being replaced while we were waiting for the lock
+    */
+    const int maxAttempts = 3;
+    for (int attempt = 0; attempt < maxAttempts; ++attempt)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+            return false;
+
+        struct stat fdStat, pathStat;
+        if (flock(fd, LOCK_EX) == -1 || fstat(fd, &fdStat) == -1)
+        {
+            close(fd);
+            return false;
+        }
+        if (stat(path.c_str(), &pathStat) == -1 || pathStat.st_ino != fdStat.st_ino || pathStat.st_dev != fdStat.st_dev)
+        {
+            close(fd); // replaced by another shell, open the new one
+            continue;
+        }
+
+        if (!IsValidFile(fd, fdStat.st_size))
+        {
+            if (fdStat.st_size == 0)
+            {
+                // nobody maps a file without a valid header, so it's safe to set it up in place
+                if (!InitFile(fd))
+                {
+                    close(fd);
+                    return false;
+                }
+            }
+            else
+            {
+                const std::string tmpPath = path + '.' + std::to_string(getpid());
+                int tmpFd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                const bool bReplaced = (tmpFd != -1 && InitFile(tmpFd) && rename(tmpPath.c_str(), path.c_str()) == 0);
+                if (tmpFd != -1)
+                    close(tmpFd);
+                close(fd);
+                if (!bReplaced)
+                {
+                    unlink(tmpPath.c_str());
+                    return false;
+                }
+                continue; // open the new file
+            }
+        }
+
+        void *mapping = mmap(nullptr, sizeof(File), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd); // the mapping keeps its own reference to the file, closing also releases the lock
+        if (mapping == MAP_FAILED)
+            return false;
+
+        m_File = static_cast<File *>(mapping);
+        return true;
+    }
+    return false;
+}
+
+JobStats::Entry *JobStats::FindEntry(const char *name, bool bCreate)
+{
+    // a shell that died between claiming a slot and publishing its hash would leave it claimed forever
+    const int maxClaimedWaits = 1000;
+
+    const uint64_t hash = HashName(name);
+    for (int probe = 0; probe < MAX_ENTRIES; ++probe)
+    {
+        Entry &entry = m_File->m_Entries[(hash + probe) & (MAX_ENTRIES - 1)];
+        uint64_t slotHash = __atomic_load_n(&entry.m_Hash, __ATOMIC_ACQUIRE);
+        for (int wait = 0; slotHash == CLAIMED_SLOT && wait < maxClaimedWaits; ++wait)
+        {
+            sched_yield(); // another shell is writing the name, it may be ours
+            slotHash = __atomic_load_n(&entry.m_Hash, __ATOMIC_ACQUIRE);
+        }
+
+        if (slotHash == hash)
+            return &entry;
+        if (slotHash != FREE_SLOT)
+            continue; // slot taken by another name, keep probing
+
+        if (!bCreate)
+            return nullptr;
+
+        // claim the free slot first and only publish the hash once the name is written,
+        // so that readers in other shells never see an entry without its name
+        uint64_t expected = FREE_SLOT;
+        if (__atomic_compare_exchange_n(&entry.m_Hash, &expected, CLAIMED_SLOT, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            strncpy(entry.m_Name, name, MAX_NAME_LEN - 1);
+            __atomic_store_n(&entry.m_Hash, hash, __ATOMIC_RELEASE);
+            return &entry;
+        }
+
+        // another shell beat us to the slot, look at it again
+        --probe;
+    }
+    return nullptr; // table is full
+}
+
+void JobStats::Record(const char *name, bool bFailed, uint64_t wallTimeUs, uint64_t cpuTimeUs)
+{
+    if (!m_File)
+        return;
+
+    Entry *entry = FindEntry(name, true);
+    if (!entry)
+        return;
+
+    __atomic_fetch_add(&entry->m_Runs, 1, __ATOMIC_RELAXED);
+    if (bFailed)
+        __atomic_fetch_add(&entry->m_Failures, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->m_WallTime.m_Buckets[GetBucketIdx(wallTimeUs)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->m_CpuTime.m_Buckets[GetBucketIdx(cpuTimeUs)], 1, __ATOMIC_RELAXED);
+}
+
+void JobStats::Print(size_t count, SortOrder order) const
+{
+    if (!m_File)
+        return;
+
+    struct Row
+    {
+        const Entry *m_Entry;
+        uint64_t m_Runs;
+        uint64_t m_SortKey;
+    };
+
+    std::vector<Row> rows;
+    for (const auto &entry : m_File->m_Entries)
+    {
+        if (__atomic_load_n(&entry.m_Hash, __ATOMIC_ACQUIRE) <= CLAIMED_SLOT)
+            continue; // free, or the name isn't written yet
+        uint64_t runs = __atomic_load_n(&entry.m_Runs, __ATOMIC_RELAXED);
+        if (runs == 0)
+            continue;
+        uint64_t sortKey = (order == SortOrder::SLOWEST) ? GetPercentile(entry.m_WallTime, 95) : runs;
+        rows.push_back({&entry, runs, sortKey});
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        return a.m_SortKey > b.m_SortKey;
+    });
+    if (rows.size() > count)
+        rows.resize(count);
+
+    printf("%-24s %8s %8s %10s %10s %10s %10s %10s %10s\n", "COMMAND", "RUNS", "FAILED",
+           "WALL p50", "p95", "p99", "CPU p50", "p95", "p99");
+    for (const auto &row : rows)
+    {
+        const Entry &entry = *row.m_Entry;
+        printf("%-24.*s %8lu %8lu %10s %10s %10s %10s %10s %10s\n", MAX_NAME_LEN, entry.m_Name,
+               static_cast<unsigned long>(row.m_Runs),
+               static_cast<unsigned long>(__atomic_load_n(&entry.m_Failures, __ATOMIC_RELAXED)),
+               FormatDuration(GetPercentile(entry.m_WallTime, 50)).c_str(),
+               FormatDuration(GetPercentile(entry.m_WallTime, 95)).c_str(),
+               FormatDuration(GetPercentile(entry.m_WallTime, 99)).c_str(),
+               FormatDuration(GetPercentile(entry.m_CpuTime, 50)).c_str(),
+               FormatDuration(GetPercentile(entry.m_CpuTime, 95)).c_str(),
+               FormatDuration(GetPercentile(entry.m_CpuTime, 99)).c_str());
+    }
+}
+
+int JobStats::GetBucketIdx(uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT)
+        return static_cast<int>(value); // first magnitude is linear
+
+    const int msb = 63 - __builtin_clzll(value);
+    const int magnitude = msb - SUB_BUCKET_BITS + 1;
+    if (magnitude >= MAGNITUDE_COUNT)
+        return BUCKET_COUNT - 1; // clamp overflowing values into the last bucket
+
+    const int subBucket = static_cast<int>((value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1));
+    return magnitude * SUB_BUCKET_COUNT + subBucket;
+}
+
+uint64_t JobStats::GetBucketValue(int bucketIdx)
+{
+    const int magnitude = bucketIdx / SUB_BUCKET_COUNT;
+    const int subBucket = bucketIdx % SUB_BUCKET_COUNT;
+    if (magnitude == 0)
+        return subBucket;
+
+    const uint64_t width = 1ULL << (magnitude - 1);
+    const uint64_t lowest = static_cast<uint64_t>(SUB_BUCKET_COUNT + subBucket) << (magnitude - 1);
+    return lowest + width / 2;
+}
+
+uint64_t JobStats::GetPercentile(const Histogram &histogram, double percentile)
+{
+    const uint64_t total = GetTotalCount(histogram);
+    if (total == 0)
+        return 0;
+
+    // rank of the sample we are looking for (1-based)
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (int idx = 0; idx < BUCKET_COUNT; ++idx)
+    {
+        seen += __atomic_load_n(&histogram.m_Buckets[idx], __ATOMIC_RELAXED);
+        if (seen >= rank)
+            return GetBucketValue(idx);
+    }
+    return GetBucketValue(BUCKET_COUNT - 1);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <sys/types.h>
+
+/*
+    per-command aggregates (run count, failure count, wall/cpu time histograms)
+    kept in a memory-mapped file so that they persist across shell sessions.
+
+    the file is a fixed-size open-addressing table keyed on the hash of the job name,
+    entries are claimed and updated with atomic operations so that several shells
+    can share the same file without locking, and so that it's safe to record from
+    the SIGCHLD handler (no allocations on that path).
+*/
+class JobStats
+{
+public:
+    // histograms use HDR-style log-linear buckets:
+    // every power of two range is split into SUB_BUCKET_COUNT linear sub-buckets
+    // so buckets are ~3% wide, fine enough for a 5% regression to move the percentiles
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAGNITUDE_COUNT = 32; // values (in microseconds) up to ~19 hours, longer ones land in the last bucket
+    static constexpr int BUCKET_COUNT = MAGNITUDE_COUNT * SUB_BUCKET_COUNT;
+
+    static constexpr int MAX_ENTRIES = 256; // must be a power of two
+    static constexpr int MAX_NAME_LEN = 64;
+
+    struct Histogram
+    {
+        uint32_t m_Buckets[BUCKET_COUNT];
+    };
+
+    struct Entry
+    {
+        uint64_t m_Hash; // FREE_SLOT, CLAIMED_SLOT while the name is being written, or the hash of m_Name
+        char m_Name[MAX_NAME_LEN];
+        uint64_t m_Runs;
+        uint64_t m_Failures;
+        Histogram m_WallTime;
+        Histogram m_CpuTime;
+    };
+
+    enum class SortOrder
+    {
+        SLOWEST,      // by p95 wall time
+        MOST_FREQUENT // by run count
+    };
+
+private:
+    struct Header
+    {
+        uint32_t m_Magic;
+        uint32_t m_Version;
+        uint32_t m_EntryCount;
+        uint32_t m_BucketCount;
+    };
+
+    struct File
+    {
+        Header m_Header;
+        Entry m_Entries[MAX_ENTRIES];
+    };
+
+    static constexpr uint32_t FILE_MAGIC = 0x54534843; // "CHST"
+    static constexpr uint32_t FILE_VERSION = 2;
+
+    static constexpr uint64_t FREE_SLOT = 0;
+    static constexpr uint64_t CLAIMED_SLOT = 1;
+
+    File *m_File = nullptr;
+
+    Entry *FindEntry(const char *name, bool bCreate);
+
+    static bool IsValidFile(int fd, off_t size);
+
+    // sizes the file and writes its header
+    static bool InitFile(int fd);
+
+public:
+    JobStats() = default;
+    JobStats(const JobStats &) = delete;
+    JobStats &operator=(const JobStats &) = delete;
+    ~JobStats();
+
+    // maps the stats file at path (creating it if it doesn't exist)
+    // returns false if the file couldn't be mapped
+    bool Open(const std::string &path);
+
+    bool IsOpen() const
+    {
+        return m_File != nullptr;
+    }
+
+    // records one finished run of the job named name, safe to call from a signal handler
+    void Record(const char *name, bool bFailed, uint64_t wallTimeUs, uint64_t cpuTimeUs);
+
+    // prints the top count entries sorted by order to stdout
+    void Print(size_t count, SortOrder order) const;
+
+    static int GetBucketIdx(uint64_t value);
+
+    // returns the value in the middle of the range covered by the bucket
+    static uint64_t GetBucketValue(int bucketIdx);
+
+    // returns the approximate value at percentile (0-100) of histogram
+    static uint64_t GetPercentile(const Histogram &histogram, double percentile);
+};
@@ -0,0 +1,255 @@
+#include "JobStatusPage.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sched.h>
+
+namespace
+{
+int64_t ToMicroseconds(const struct timeval &time)
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_usec;
+}
+
+void PrintJsonEntry(FILE *file, const JobStatusEntry &entry)
+{
+    fprintf(file,
+            "{\"id\":%d,\"pid\":%d,\"name\":\"%s\",\"status\":\"%s\",\"exec_type\":\"%s\","
+            "\"start_time_ms\":%lld,\"user_time_us\":%lld,\"system_time_us\":%lld,\"max_rss_kb\":%lld",
+            entry.m_JobIdx, entry.m_Pid,
+            Util::EscapeJson(std::string(entry.m_Name, strnlen(entry.m_Name, sizeof(entry.m_Name)))).c_str(),
+            Job::GetStatusString(static_cast<JobStatus>(entry.m_Status)),
+            static_cast<ExecutionType>(entry.m_ExecType) == ExecutionType::BACKGROUND ? "background" : "foreground",
+            static_cast<long long>(entry.m_StartTimeMs), static_cast<long long>(entry.m_UserTimeUs),
+            static_cast<long long>(entry.m_SystemTimeUs), static_cast<long long>(entry.m_MaxRssKb));
+
+    const auto status = static_cast<JobStatus>(entry.m_Status);
+    if (status == JobStatus::STATUS_EXITED)
+        fprintf(file, ",\"exit_code\":%d", WEXITSTATUS(entry.m_ExitStatus));
+    else if (status == JobStatus::STATUS_TERMINATED)
+        fprintf(file, ",\"signal\":%d", WTERMSIG(entry.m_ExitStatus));
+    fputc('}', file);
+}
+} // namespace
+
+JobStatusPage::~JobStatusPage()
+{
+    if (m_Data)
+        munmap(m_Data, sizeof(Data));
+}
+
+bool JobStatusPage::Create(pid_t shellPid)
+{
+    m_Name = GetName(shellPid);
+    m_OwnerPid = shellPid;
+    int fd = shm_open(m_Name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return false;
+
+    if (ftruncate(fd, sizeof(Data)) == -1)
+    {
+        close(fd);
+        shm_unlink(m_Name.c_str());
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, sizeof(Data), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        shm_unlink(m_Name.c_str());
+        return false;
+    }
+
+    // the segment is zero-filled, readers ignore it till the magic shows up
+    m_Data = static_cast<Data *>(mapping);
+    m_Data->m_Version = PAGE_VERSION;
+    m_Data->m_ShellPid = shellPid;
+    __atomic_store_n(&m_Data->m_Magic, PAGE_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+void JobStatusPage::Destroy()
+{
+    if (!m_Data)
+        return;
+    Unlink();
+    munmap(m_Data, sizeof(Data));
+    m_Data = nullptr;
+}
+
+void JobStatusPage::Unlink()
+{
+    // substitution children run builtins like exit in a fork of the shell
+    if (m_Data && getpid() == m_OwnerPid)
+        shm_unlink(m_Name.c_str());
+}
+
+void JobStatusPage::BeginWrite()
+{
+    const uint64_t sequence = __atomic_load_n(&m_Data->m_Sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_Data->m_Sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // the odd sequence must be visible before any of the data changes
+}
+
+void JobStatusPage::EndWrite()
+{
+    const uint64_t sequence = __atomic_load_n(&m_Data->m_Sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_Data->m_Sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void JobStatusPage::Publish(const std::vector<Job> &jobs)
+{
+    if (!m_Data)
+        return;
+
+    const size_t count = std::min<size_t>(jobs.size(), MAX_JOBS);
+    BeginWrite();
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        m_Data->m_Jobs[idx] = MakeEntry(jobs[idx], static_cast<int>(idx));
+    }
+    m_Data->m_JobCount = static_cast<uint32_t>(count);
+    m_Data->m_bTruncated = (jobs.size() > MAX_JOBS);
+    EndWrite();
+}
+
+void JobStatusPage::AddFinished(const Job &job, int status)
+{
+    if (!m_Data)
+        return;
+
+    JobStatusEntry entry = MakeEntry(job, -1);
+    entry.m_ExitStatus = status;
+
+    BeginWrite();
+    m_Data->m_Finished[m_Data->m_FinishedCount % MAX_FINISHED] = entry;
+    m_Data->m_FinishedCount++;
+    EndWrite();
+}
+
+JobStatusEntry JobStatusPage::MakeEntry(const Job &job, int idx)
+{
+    JobStatusEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.m_Pid = job.GetPID();
+    entry.m_JobIdx = idx;
+    entry.m_Status = static_cast<uint8_t>(job.GetStatus());
+    entry.m_ExecType = static_cast<uint8_t>(job.GetExecType());
+    entry.m_StartTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(job.GetStartRealTime().time_since_epoch()).count();
+
+    const auto &usage = job.GetUsage();
+    entry.m_UserTimeUs = ToMicroseconds(usage.ru_utime);
+    entry.m_SystemTimeUs = ToMicroseconds(usage.ru_stime);
+    entry.m_MaxRssKb = usage.ru_maxrss;
+    strncpy(entry.m_Name, job.GetName().c_str(), sizeof(entry.m_Name) - 1);
+    return entry;
+}
+
+bool JobStatusPage::Read(const std::string &name, JobStatusSnapshot &snapshot)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size != sizeof(Data))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, sizeof(Data), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    const Data *data = static_cast<const Data *>(mapping);
+
+    // updates take microseconds, a page that stays odd for this long belongs to a shell that died while writing it
+    const int maxAttempts = 100000;
+    bool bValid = (__atomic_load_n(&data->m_Magic, __ATOMIC_ACQUIRE) == PAGE_MAGIC && data->m_Version == PAGE_VERSION);
+    for (int attempt = 0; bValid; ++attempt)
+    {
+        if (attempt == maxAttempts)
+        {
+            bValid = false;
+            break;
+        }
+
+        const uint64_t before = __atomic_load_n(&data->m_Sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            // the shell is in the middle of an update, unless it's gone
+            if (kill(data->m_ShellPid, 0) == -1 && errno == ESRCH)
+            {
+                bValid = false;
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        snapshot.m_ShellPid = data->m_ShellPid;
+        snapshot.m_UpdateCount = before / 2;
+        snapshot.m_bTruncated = data->m_bTruncated;
+        const uint32_t jobCount = std::min<uint32_t>(data->m_JobCount, MAX_JOBS);
+        snapshot.m_Jobs.assign(data->m_Jobs, data->m_Jobs + jobCount);
+
+        const uint32_t finishedCount = data->m_FinishedCount;
+        const uint32_t keptCount = std::min<uint32_t>(finishedCount, MAX_FINISHED);
+        snapshot.m_Finished.clear();
+        for (uint32_t i = finishedCount - keptCount; i != finishedCount; ++i)
+            snapshot.m_Finished.push_back(data->m_Finished[i % MAX_FINISHED]);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); // the copies above must complete before checking the sequence again
+        if (__atomic_load_n(&data->m_Sequence, __ATOMIC_RELAXED) == before)
+            break;
+    }
+
+    munmap(mapping, sizeof(Data));
+    return bValid;
+}
+
+std::vector<std::string> JobStatusPage::List()
+{
+    std::vector<std::string> names;
+    if (DIR *dir = opendir("/dev/shm"))
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            if (strncmp(entry->d_name, "cshell.", strlen("cshell.")) == 0)
+                names.push_back(std::string("/") + entry->d_name);
+        }
+        closedir(dir);
+    }
+    return names;
+}
+
+void JobStatusPage::PrintJson(FILE *file, const JobStatusSnapshot &snapshot)
+{
+    fprintf(file, "{\"shell_pid\":%d,\"updates\":%llu,\"truncated\":%s,\"jobs\":[", snapshot.m_ShellPid,
+            static_cast<unsigned long long>(snapshot.m_UpdateCount), snapshot.m_bTruncated ? "true" : "false");
+    for (size_t i = 0; i < snapshot.m_Jobs.size(); ++i)
+    {
+        if (i != 0)
+            fputc(',', file);
+        PrintJsonEntry(file, snapshot.m_Jobs[i]);
+    }
+    fprintf(file, "],\"finished\":[");
+    for (size_t i = 0; i < snapshot.m_Finished.size(); ++i)
+    {
+        if (i != 0)
+            fputc(',', file);
+        PrintJsonEntry(file, snapshot.m_Finished[i]);
+    }
+    fprintf(file, "]}\n");
+}
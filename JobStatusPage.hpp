@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "Job.hpp"
+
+struct JobStatusEntry
+{
+    int32_t m_Pid;
+    int32_t m_JobIdx;       // index shown by jobs (-1 for finished jobs)
+    uint8_t m_Status;       // JobStatus
+    uint8_t m_ExecType;     // ExecutionType
+    int32_t m_ExitStatus;   // raw wait status of finished jobs
+    int64_t m_StartTimeMs;  // unix time in milliseconds
+    int64_t m_UserTimeUs;
+    int64_t m_SystemTimeUs;
+    int64_t m_MaxRssKb;
+    char m_Name[64];
+};
+
+// a consistent copy of the status page of one shell
+struct JobStatusSnapshot
+{
+    pid_t m_ShellPid = 0;
+    uint64_t m_UpdateCount = 0;
+    bool m_bTruncated = false; // the shell had more jobs than fit in the page
+    std::vector<JobStatusEntry> m_Jobs;
+    std::vector<JobStatusEntry> m_Finished; // most recently finished jobs, oldest first
+};
+
+/*
+    publishes the job table of a shell in a POSIX shared memory segment (/cshell.<pid>)
+    so that external monitors can watch it without interacting with the shell.
+
+    the page is guarded by a seqlock: the shell bumps the sequence to an odd value,
+    writes the page and bumps it again to an even value, readers retry if the
+    sequence was odd or changed while they were copying, so the shell never waits on them.
+*/
+class JobStatusPage
+{
+public:
+    static constexpr int MAX_JOBS = 256;
+    static constexpr int MAX_FINISHED = 32;
+
+private:
+    struct Data
+    {
+        uint32_t m_Magic;
+        uint32_t m_Version;
+        uint64_t m_Sequence; // odd while the shell is writing
+        int32_t m_ShellPid;
+        uint32_t m_JobCount;
+        uint32_t m_bTruncated;
+        uint32_t m_FinishedCount; // total finished jobs, the latest MAX_FINISHED are kept in a ring
+        JobStatusEntry m_Jobs[MAX_JOBS];
+        JobStatusEntry m_Finished[MAX_FINISHED];
+    };
+
+    static constexpr uint32_t PAGE_MAGIC = 0x534a4843; // "CHJS"
+    static constexpr uint32_t PAGE_VERSION = 1;
+
+    Data *m_Data = nullptr;
+    std::string m_Name;
+    pid_t m_OwnerPid = 0; // forked children share the mapping but must never remove the segment
+
+    void BeginWrite();
+    void EndWrite();
+
+public:
+    JobStatusPage() = default;
+    JobStatusPage(const JobStatusPage &) = delete;
+    JobStatusPage &operator=(const JobStatusPage &) = delete;
+    ~JobStatusPage();
+
+    static std::string GetName(pid_t shellPid)
+    {
+        return "/cshell." + std::to_string(shellPid);
+    }
+
+    // creates the segment of the shell with pid shellPid, returns false on failure
+    bool Create(pid_t shellPid);
+
+    // unmaps the segment and removes it if called by the shell that created it
+    void Destroy();
+
+    // removes the segment if called by the shell that created it, safe to call from a signal handler
+    void Unlink();
+
+    // replaces the published job table with jobs, safe to call from a signal handler
+    void Publish(const std::vector<Job> &jobs);
+
+    // adds job which has just exited or got terminated to the finished jobs
+    void AddFinished(const Job &job, int status);
+
+    static JobStatusEntry MakeEntry(const Job &job, int idx);
+
+    // copies the segment called name, retrying while the shell is writing to it
+    // returns false if it doesn't exist, isn't a status page or stays in the middle of an update
+    // (the shell died while writing it)
+    static bool Read(const std::string &name, JobStatusSnapshot &snapshot);
+
+    // lists the names of all the status pages in /dev/shm
+    static std::vector<std::string> List();
+
+    static void PrintJson(FILE *file, const JobStatusSnapshot &snapshot);
+};
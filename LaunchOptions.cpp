@@ -0,0 +1,252 @@
+#include "LaunchOptions.hpp"
+#include "Util.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <map>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace
+{
+// from linux/ioprio.h, which isn't exposed by glibc
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+constexpr int IOPRIO_WHO_PROCESS = 1;
+
+bool ParseNumber(const std::string &str, long long &value)
+{
+    if (str.empty())
+        return false;
+    char *end = nullptr;
+    errno = 0;
+    value = strtoll(str.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+bool ParseLimitValue(const std::string &str, rlim_t &value)
+{
+    if (str == "unlimited")
+    {
+        value = RLIM_INFINITY;
+        return true;
+    }
+    long long number;
+    if (!ParseNumber(str, number) || number < 0)
+        return false;
+    value = static_cast<rlim_t>(number);
+    return true;
+}
+
+int GetResourceByName(const std::string &name)
+{
+    static const std::map<std::string, int> resources = {
+        {"as", RLIMIT_AS},
+        {"core", RLIMIT_CORE},
+        {"cpu", RLIMIT_CPU},
+        {"data", RLIMIT_DATA},
+        {"fsize", RLIMIT_FSIZE},
+        {"memlock", RLIMIT_MEMLOCK},
+        {"nofile", RLIMIT_NOFILE},
+        {"nproc", RLIMIT_NPROC},
+        {"rss", RLIMIT_RSS},
+        {"stack", RLIMIT_STACK},
+    };
+    const auto it = resources.find(name);
+    return it != resources.end() ? it->second : -1;
+}
+
+// cpus of every numa node keyed on the node id, read once from sysfs
+const std::map<int, cpu_set_t> &GetNodes()
+{
+    static std::map<int, cpu_set_t> nodes;
+    static bool bLoaded = false;
+    if (bLoaded)
+        return nodes;
+    bLoaded = true;
+
+    const char *nodesPath = "/sys/devices/system/node";
+    if (DIR *dir = opendir(nodesPath))
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            int id;
+            char extra;
+            if (sscanf(entry->d_name, "node%d%c", &id, &extra) != 1)
+                continue;
+
+            std::ifstream cpulistFile(std::string(nodesPath) + '/' + entry->d_name + "/cpulist");
+            std::string cpulist;
+            cpu_set_t cpus;
+            if (std::getline(cpulistFile, cpulist) && Util::ParseCPUList(cpulist, cpus))
+                nodes[id] = cpus; // node ids can be sparse
+        }
+        closedir(dir);
+    }
+
+    return nodes;
+}
+} // namespace
+
+bool LaunchOptions::Parse(std::vector<std::string> &args, std::string &error)
+{
+    size_t count = 0;
+    for (; count < args.size() && args[count][0] == '@'; ++count)
+    {
+        const auto &arg = args[count];
+        const auto separator = arg.find('=');
+        const std::string key = arg.substr(1, separator - 1);
+        const std::string value = (separator != std::string::npos) ? arg.substr(separator + 1) : "";
+        long long number;
+
+        if (key == "cpus")
+        {
+            if (!Util::ParseCPUList(value, m_Affinity))
+            {
+                error = "@cpus: invalid cpu list '" + value + "'";
+                return false;
+            }
+            m_bHasAffinity = true;
+        }
+        else if (key == "numa")
+        {
+            if (!ParseNumber(value, number) || !GetNodeAffinity(static_cast<int>(number), m_Affinity))
+            {
+                error = "@numa: no such node '" + value + "'";
+                return false;
+            }
+            m_bHasAffinity = true;
+        }
+        else if (key == "nice")
+        {
+            if (!ParseNumber(value, number) || number < -20 || number > 19)
+            {
+                error = "@nice: value must be between -20 and 19";
+                return false;
+            }
+            m_Nice = static_cast<int>(number);
+            m_bHasNice = true;
+        }
+        else if (key == "ioprio")
+        {
+            const auto colon = value.find(':');
+            const std::string ioClass = value.substr(0, colon);
+            long long level = 0;
+            if (colon != std::string::npos && (!ParseNumber(value.substr(colon + 1), level) || level < 0 || level > 7))
+            {
+                error = "@ioprio: level must be between 0 and 7";
+                return false;
+            }
+
+            int classIdx;
+            if (ioClass == "rt")
+                classIdx = 1;
+            else if (ioClass == "be")
+                classIdx = 2;
+            else if (ioClass == "idle")
+                classIdx = 3;
+            else
+            {
+                error = "@ioprio: class must be one of rt, be, idle";
+                return false;
+            }
+            m_IOPrio = (classIdx << IOPRIO_CLASS_SHIFT) | static_cast<int>(level);
+            m_bHasIOPrio = true;
+        }
+        else if (key == "limit")
+        {
+            const auto parts = Util::Tokenize(value, ":");
+            Limit limit;
+            limit.m_Resource = parts.empty() ? -1 : GetResourceByName(parts[0]);
+            if (limit.m_Resource == -1 || parts.size() < 2 || parts.size() > 3 ||
+                !ParseLimitValue(parts[1], limit.m_Soft) ||
+                !ParseLimitValue(parts.size() == 3 ? parts[2] : parts[1], limit.m_Hard))
+            {
+                error = "@limit: expected resource:soft[:hard] got '" + value + "'";
+                return false;
+            }
+            m_Limits.push_back(limit);
+        }
+        else
+        {
+            error = "unknown launch option '" + arg + "'";
+            return false;
+        }
+    }
+
+    args.erase(args.begin(), args.begin() + count);
+    return true;
+}
+
+const char *LaunchOptions::Apply() const
+{
+    for (const auto &limit : m_Limits)
+    {
+        struct rlimit rlim = {limit.m_Soft, limit.m_Hard};
+        if (setrlimit(limit.m_Resource, &rlim) == -1)
+            return "@limit";
+    }
+
+    if (m_bHasAffinity && sched_setaffinity(0, sizeof(m_Affinity), &m_Affinity) == -1)
+        return "@cpus";
+
+    if (m_bHasNice && setpriority(PRIO_PROCESS, 0, m_Nice) == -1)
+        return "@nice";
+
+    if (m_bHasIOPrio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, m_IOPrio) == -1)
+        return "@ioprio";
+
+    return nullptr;
+}
+
+bool LaunchOptions::GetSpreadAffinity(SpreadMode mode, size_t slot, cpu_set_t &cpus)
+{
+    cpu_set_t allowed;
+    if (mode == SpreadMode::OFF || sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return false;
+
+    if (mode == SpreadMode::NUMA)
+    {
+        // only nodes that have cpus we are allowed to run on take part in the rotation
+        std::vector<cpu_set_t> nodes;
+        for (const auto &node : GetNodes())
+        {
+            cpu_set_t usable;
+            CPU_AND(&usable, &node.second, &allowed);
+            if (CPU_COUNT(&usable) > 0)
+                nodes.push_back(usable);
+        }
+        if (nodes.empty())
+            return false;
+        cpus = nodes[slot % nodes.size()];
+        return true;
+    }
+
+    // SpreadMode::CPU
+    const int cpuCount = CPU_COUNT(&allowed);
+    int target = static_cast<int>(slot % cpuCount);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0)
+        {
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LaunchOptions::GetNodeAffinity(int node, cpu_set_t &cpus)
+{
+    const auto &nodes = GetNodes();
+    const auto it = nodes.find(node);
+    cpu_set_t allowed;
+    if (it == nodes.end() || sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return false;
+
+    CPU_AND(&cpus, &it->second, &allowed);
+    return CPU_COUNT(&cpus) > 0;
+}
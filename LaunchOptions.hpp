@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <sys/resource.h>
+
+enum class SpreadMode
+{
+    OFF,  // background jobs inherit the shell affinity
+    CPU,  // background jobs are pinned round-robin to a single cpu each
+    NUMA, // background jobs are bound round-robin to the cpus of a numa node each
+};
+
+/*
+    launch modifiers that are applied in the child process right before exec
+    so that we don't need wrappers like taskset/prlimit/nice/ionice.
+
+    they are given as leading arguments of a command:
+        @cpus=0-3,8           bind to the listed cpus
+        @numa=1               bind to the cpus of numa node 1
+        @nice=10              set the nice value
+        @ioprio=be:4          set the io class (rt, be, idle) and level (0-7)
+        @limit=nofile:1024    set soft and hard limit of a resource (soft:hard can be given too)
+*/
+class LaunchOptions
+{
+    struct Limit
+    {
+        int m_Resource;
+        rlim_t m_Soft;
+        rlim_t m_Hard;
+    };
+
+    bool m_bHasAffinity = false;
+    cpu_set_t m_Affinity;
+    bool m_bHasNice = false;
+    int m_Nice = 0;
+    bool m_bHasIOPrio = false;
+    int m_IOPrio = 0;
+    std::vector<Limit> m_Limits;
+
+public:
+    // removes the leading launch modifiers from args
+    // returns false and fills error if a modifier couldn't be parsed
+    bool Parse(std::vector<std::string> &args, std::string &error);
+
+    bool HasAffinity() const
+    {
+        return m_bHasAffinity;
+    }
+
+    void SetAffinity(const cpu_set_t &cpus)
+    {
+        m_Affinity = cpus;
+        m_bHasAffinity = true;
+    }
+
+    // applies the options to the calling process, meant to be called in the child before exec
+    // returns the name of the option that failed (errno is set) or nullptr on success
+    const char *Apply() const;
+
+    // picks the cpus for the next background job according to mode
+    // returns false if there is nothing to bind to
+    static bool GetSpreadAffinity(SpreadMode mode, size_t slot, cpu_set_t &cpus);
+
+    // returns the cpus of numa node (limited to the ones the shell may run on)
+    static bool GetNodeAffinity(int node, cpu_set_t &cpus);
+};
@@ -0,0 +1,31 @@
+#include "RcFile.hpp"
+#include "Util.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+bool RcFile::Load(const std::string &rcPath, Commands &commands)
+{
+    int fd = open(rcPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    commands = Parse(Util::ReadAll(fd));
+    close(fd);
+    return true;
+}
+
+RcFile::Commands RcFile::Parse(const std::string &text)
+{
+    Commands commands;
+    for (const auto &line : Util::Tokenize(text, "\n"))
+    {
+        const auto first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+            continue; // skip empty lines and comments
+
+        auto args = Util::TokenizeCommandLine(line);
+        if (!args.empty())
+            commands.push_back(std::move(args));
+    }
+    return commands;
+}
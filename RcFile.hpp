@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/*
+    loads the commands of an rc file (~/.cshellrc) in their tokenized form.
+
+    the rc file is read and tokenized on every start, a few lines take a fraction of the
+    open/fstat calls any cache of them would need, so nothing is cached on disk.
+*/
+class RcFile
+{
+public:
+    using Commands = std::vector<std::vector<std::string>>;
+
+    // returns false if the rc file doesn't exist or can't be read
+    static bool Load(const std::string &rcPath, Commands &commands);
+
+private:
+    static Commands Parse(const std::string &text);
+};
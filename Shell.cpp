@@ -1,8 +1,119 @@
 #include "Shell.hpp"
 
-Shell::Shell() : m_PrevWorkingDir(GetCurrWorkingDir())
+void Shell::Init(bool bProfileStartup)
 {
-    std::string absolutePath = GetAbsolutePath();
+    // only the work that must be done before the first prompt is done here,
+    // the log/stats files, the username and the working directory are looked up once they are needed
+    std::vector<std::pair<const char *, double>> steps;
+    auto Step = [&](const char *name, const std::function<void()> &step) {
+        const auto start = std::chrono::steady_clock::now();
+        step();
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        steps.emplace_back(name, elapsed.count());
+    };
+
+    Step("import environment", [&] {
+        // the inherited environment becomes the initial set of exported variables
+        m_Variables.Import(environ);
+    });
+
+    Step("signal handlers", [&] {
+        // add a handler for SIGCHLD signal to update the children status and log them
+        auto SIGCHLD_Handler = [](int signal) {
+            const int savedErrno = errno; // don't clobber errno of whatever got interrupted
+            gShell.UpdateJobsStatus();
+            errno = savedErrno;
+        };
+
+        signal(SIGCHLD, SIGCHLD_Handler);
+
+        /*
+            replace behaviour of (CTRL + C) which terminates the shell
+            and  (CTRL + Z)  which stops the shell
+            and  (CTRL + \)  which dumps core and terminates the shell
+            to just print newline just like how most shell does it
+        */
+        struct sigaction sigIgnore_action;
+        sigIgnore_action.sa_handler = [](int signal) {
+            std::cout << std::endl;
+        };
+        sigIgnore_action.sa_flags = 0;
+        sigemptyset(&sigIgnore_action.sa_mask);
+        sigaction(SIGINT, &sigIgnore_action, NULL);
+        sigaction(SIGQUIT, &sigIgnore_action, NULL);
+        sigaction(SIGTSTP, &sigIgnore_action, NULL);
+
+        // the status page would outlive a shell that got hung up or terminated
+        // so it's removed before the signal takes its default action
+        auto Terminate_Handler = [](int signal) {
+            gShell.RemoveStatusPage();
+            ::signal(signal, SIG_DFL);
+            raise(signal);
+        };
+        struct sigaction sigTerminate_action;
+        sigTerminate_action.sa_handler = Terminate_Handler;
+        sigTerminate_action.sa_flags = 0;
+        sigemptyset(&sigTerminate_action.sa_mask);
+        sigaction(SIGHUP, &sigTerminate_action, NULL);
+        sigaction(SIGTERM, &sigTerminate_action, NULL);
+
+        // prevent jobs running in background from stopping the shell
+        // when trying to read/write from terminal
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+    });
+
+    Step("terminal control", [&] {
+        pid_t pid = getpid(); // get pid of the shell
+        setpgid(pid, pid);    // set process group id of the shell process to be itself
+
+        tcsetpgrp(STDIN_FILENO, pid); // make shell pgid the foreground pgid on the termianl associated to STDIN_FILENO
+    });
+
+    const std::string *home = m_Variables.Get("HOME");
+    if (home)
+    {
+        RcFile::Commands commands;
+        bool bLoaded = false;
+        Step("load rc file", [&] {
+            bLoaded = RcFile::Load(*home + "/.cshellrc", commands);
+        });
+        if (bLoaded)
+        {
+            Step("run rc file", [&] {
+                for (auto &args : commands)
+                    Parse(args);
+            });
+        }
+    }
+
+    if (bProfileStartup)
+    {
+        double total = 0;
+        for (const auto &step : steps)
+        {
+            fprintf(stderr, "%s: startup: %-26s %8.3f ms\n", GetName().c_str(), step.first, step.second);
+            total += step.second;
+        }
+        fprintf(stderr, "%s: startup: %-26s %8.3f ms\n", GetName().c_str(), "total", total);
+    }
+}
+
+void Shell::OpenJobFiles()
+{
+    if (m_bJobFilesOpened)
+        return;
+    m_bJobFilesOpened = true;
+
+    // $CSHELL_DATA_DIR moves the log and stats files away from the binary,
+    // so that test runs don't end up in the stats of real sessions
+    std::string absolutePath;
+    const std::string *dataDir = m_Variables.Get("CSHELL_DATA_DIR");
+    if (dataDir && !dataDir->empty())
+        absolutePath = *dataDir + '/' + GetName();
+    else
+        absolutePath = GetAbsolutePath();
+
     if (!absolutePath.empty())
         m_LogFile = std::ofstream(absolutePath + ".log", std::ios::trunc);
     else
@@ -10,47 +121,42 @@ Shell::Shell() : m_PrevWorkingDir(GetCurrWorkingDir())
         std::cout << "Failed to get absolute path of the shell.\n";
         std::cout << "Log file will be created in current working directory instead.\n";
         m_LogFile = std::ofstream(GetName() + ".log", std::ios::trunc);
+        absolutePath = GetName();
     }
 
-    // add a handler for SIGCHLD signal to update the children status and log them
-    auto SIGCHLD_Handler = [](int signal) {
-        gShell.UpdateJobsStatus();
-    };
+    // unlike the log file, stats are kept across sessions
+    if (!m_JobStats.Open(absolutePath + ".stats"))
+    {
+        std::cout << "Failed to open stats file, job stats won't be recorded.\n";
+    }
 
-    signal(SIGCHLD, SIGCHLD_Handler);
+    if (!m_StatusPage.Create(getpid()))
+    {
+        std::cout << "Failed to create job status page, jobs won't be visible to monitors.\n";
+    }
+}
 
-    /*
-        replace behaviour of (CTRL + C) which terminates the shell
-        and  (CTRL + Z)  which stops the shell
-        and  (CTRL + \)  which dumps core and terminates the shell
-        to just print newline just like how most shell does it
-    */
-    struct sigaction sigIgnore_action;
-    sigIgnore_action.sa_handler = [](int signal) {
-        std::cout << std::endl;
-    };
-    sigIgnore_action.sa_flags = 0;
-    sigemptyset(&sigIgnore_action.sa_mask);
-    sigaction(SIGINT, &sigIgnore_action, NULL);
-    sigaction(SIGQUIT, &sigIgnore_action, NULL);
-    sigaction(SIGTSTP, &sigIgnore_action, NULL);
-
-    // prevent jobs running in background from stopping the shell
-    // when trying to read/write from terminal
-    signal(SIGTTIN, SIG_IGN);
-    signal(SIGTTOU, SIG_IGN);
-
-    pid_t pid = getpid(); // get pid of the shell
-    setpgid(pid, pid);    // set process group id of the shell process to be itself
-
-    tcsetpgrp(STDIN_FILENO, pid); // make shell pgid the foreground pgid on the termianl associated to STDIN_FILENO
-
-    // get our current logged-in username
-    struct passwd *pwd = getpwuid(getuid());
-    if (pwd)
-        m_CurrUsername = pwd->pw_name;
-    else
-        m_CurrUsername = "(?)";
+const std::string &Shell::GetUsername()
+{
+    if (m_CurrUsername.empty())
+    {
+        // prefer $USER (or $LOGNAME) since getpwuid can be slow when users come from NSS/LDAP
+        const std::string *user = m_Variables.Get("USER");
+        if (!user || user->empty())
+            user = m_Variables.Get("LOGNAME");
+        if (user && !user->empty())
+            m_CurrUsername = *user;
+        else
+        {
+            // neither is set, so the first prompt still waits for the passwd lookup
+            struct passwd *pwd = getpwuid(getuid());
+            if (pwd)
+                m_CurrUsername = pwd->pw_name;
+            else
+                m_CurrUsername = "(?)";
+        }
+    }
+    return m_CurrUsername;
 }
 
 void Shell::Run()
@@ -64,7 +170,7 @@ void Shell::Run()
         std::string line = ReadLine();
         if (!line.empty())
         {
-            std::vector<std::string> args = Util::Tokenize(line, " \t\n");
+            std::vector<std::string> args = Util::TokenizeCommandLine(line);
             Parse(args);
         }
     }
@@ -85,39 +191,87 @@ std::string Shell::ReadLine()
 void Shell::UpdateJobsStatus()
 {
     int status, pid;
+    struct rusage usage;
+    bool bHasFinishedJobs = false;
 
-    // we call waitpid with -1 to check for any child process that has changed status
+    // we call wait4 (waitpid that also reports resource usage) with -1 to check for any child process that has changed status
     // we use WNOHANG to prevent waitpid from blocking (returns immediately)
     // we use WUNTRACED to get a report about status of stopped children
     // we use WCONTINUED to get a report about status continued children
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0)
     {
-        const int idx = GetJobIdxByPID(pid);
-        if (idx == -1)
-            continue;
+        if (UpdateJobStatus(pid, status, usage))
+            bHasFinishedJobs = true;
+    }
 
-        if (WIFEXITED(status))
-        {
-            m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_EXITED);
-            m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << std::endl;
-            RemoveJob(idx);
-        }
-        else if (WIFSIGNALED(status))
-        {
-            m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_TERMINATED);
-            m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << std::endl;
-            RemoveJob(idx);
-        }
-        else if (WIFSTOPPED(status))
-        {
-            m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_STOPPED);
-            m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << std::endl;
-        }
-        else if (WIFCONTINUED(status))
-        {
-            m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_RUNNING);
-            m_LogFile << m_CurrentJobs[idx].GetName() << "\tContinued" << std::endl;
-        }
+    if (bHasFinishedJobs)
+        RemoveFinishedJobs();
+    m_LogFile.flush();
+    m_StatusPage.Publish(m_CurrentJobs);
+}
+
+bool Shell::UpdateJobStatus(pid_t pid, int status, const struct rusage &usage)
+{
+    const int idx = GetJobIdxByPID(pid);
+    if (idx == -1)
+        return false;
+    m_CurrentJobs[idx].SetUsage(usage);
+
+    // finished jobs are only marked here and removed all at once by RemoveFinishedJobs
+    // so that reaping many jobs at once doesn't keep shifting the jobs vector
+    if (WIFEXITED(status))
+    {
+        m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_EXITED);
+        m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << '\n';
+        OnJobFinished(idx, status, usage);
+        return true;
+    }
+    else if (WIFSIGNALED(status))
+    {
+        m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_TERMINATED);
+        m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << '\n';
+        OnJobFinished(idx, status, usage);
+        return true;
+    }
+    else if (WIFSTOPPED(status))
+    {
+        m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_STOPPED);
+        m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << '\n';
+    }
+    else if (WIFCONTINUED(status))
+    {
+        m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_RUNNING);
+        m_LogFile << m_CurrentJobs[idx].GetName() << "\tContinued\n";
+    }
+    return false;
+}
+
+void Shell::RemoveFinishedJobs()
+{
+    auto IsFinished = [](const Job &job) {
+        return job.GetStatus() == JobStatus::STATUS_EXITED || job.GetStatus() == JobStatus::STATUS_TERMINATED;
+    };
+    m_CurrentJobs.erase(std::remove_if(m_CurrentJobs.begin(), m_CurrentJobs.end(), IsFinished), m_CurrentJobs.end());
+}
+
+pid_t Shell::WaitForChild(pid_t pid, int options, int &status, struct rusage &usage)
+{
+    while (true)
+    {
+        // SIGCHLD is blocked while a command runs, so we wait for any child (wait4 is waitpid that also reports resource usage)
+        // and keep the other jobs up to date here, otherwise they would turn into zombies till pid is done
+        // we use WUNTRACED to return if the child process was stopped
+        // we use WCONTINUED to get a report about status continued children
+        const pid_t waitPid = wait4(-1, &status, options | WUNTRACED | WCONTINUED, &usage);
+        if (waitPid == -1 && errno == EINTR)
+            continue; // retry if some signal handler interrupted us
+        if (waitPid <= 0 || waitPid == pid)
+            return waitPid;
+
+        if (UpdateJobStatus(waitPid, status, usage))
+            RemoveFinishedJobs();
+        m_LogFile.flush();
+        m_StatusPage.Publish(m_CurrentJobs);
     }
 }
 
@@ -126,6 +280,27 @@ void Shell::Parse(std::vector<std::string> &args)
     if (args.empty())
         return; // do nothing
 
+    // the SIGCHLD handler modifies m_CurrentJobs,
+    // so we keep it from running while a command might be reading or changing the jobs
+    // any children that change status meanwhile are handled once the signal gets unblocked
+    Util::ScopedSignalBlock blockSIGCHLD(SIGCHLD);
+
+    // NAME=value ... lines only set shell variables
+    if (ExecuteAssignments(args))
+    {
+        CloseSubstitutionFds();
+        return;
+    }
+
+    // replace $NAME , ${NAME} with the value of the variable
+    // and $(...) with the output of the command and <(...) , >(...) with /dev/fd/N pipes
+    ExpandArgs(args);
+    if (args.empty())
+    {
+        CloseSubstitutionFds();
+        return;
+    }
+
     if (args.size() > 1)
     {
         for (auto &arg : args)
@@ -135,9 +310,10 @@ void Shell::Parse(std::vector<std::string> &args)
             {
                 // we check what comes after '~'  is either '/' or  just nothing
                 // just to make sure it's a path not a folder/file name
-                if (arg[1] == '/' || arg.size() == 1)
+                const std::string *home = m_Variables.Get("HOME");
+                if (home && (arg[1] == '/' || arg.size() == 1))
                 {
-                    arg.replace(0, 1, getenv("HOME"));
+                    arg.replace(0, 1, *home);
                 }
             }
         }
@@ -149,6 +325,12 @@ void Shell::Parse(std::vector<std::string> &args)
         // then it must be an external program to be launched
         LaunchJob(args);
     }
+
+    // the launched job has its own copies of the substitution pipes by now
+    CloseSubstitutionFds();
+
+    // launching, continuing or disowning jobs changes the job table
+    m_StatusPage.Publish(m_CurrentJobs);
 }
 
 bool Shell::ExecuteBuiltinCommands(const std::vector<std::string> &args)
@@ -157,6 +339,14 @@ bool Shell::ExecuteBuiltinCommands(const std::vector<std::string> &args)
     {
         CMD::cd(*this, args);
     }
+    else if (args[0] == "pwd")
+    {
+        CMD::pwd(*this, args);
+    }
+    else if (args[0] == "echo")
+    {
+        CMD::echo(*this, args);
+    }
     else if (args[0] == "jobs")
     {
         CMD::jobs(*this, args);
@@ -182,9 +372,45 @@ bool Shell::ExecuteBuiltinCommands(const std::vector<std::string> &args)
             std::cout << GetName() << ": disown: " << args[1] << ": no such job\n";
         }
     }
+    else if (args[0] == "stats")
+    {
+        if (!CMD::stats(*this, args))
+        {
+            std::cout << GetName() << ": stats: usage: stats [-f] [-n count]\n";
+        }
+    }
+    else if (args[0] == "ulimit")
+    {
+        if (!CMD::ulimit(*this, args))
+        {
+            std::cout << GetName() << ": ulimit: usage: ulimit [-SHa] [-cdflmnstuv] [limit]\n";
+        }
+    }
+    else if (args[0] == "spread")
+    {
+        if (!CMD::spread(*this, args))
+        {
+            std::cout << GetName() << ": spread: usage: spread [off|cpu|numa]\n";
+        }
+    }
+    else if (args[0] == "export")
+    {
+        if (!CMD::export_(*this, args))
+        {
+            std::cout << GetName() << ": export: not a valid identifier\n";
+        }
+    }
+    else if (args[0] == "unset")
+    {
+        if (!CMD::unset(*this, args))
+        {
+            std::cout << GetName() << ": unset: not a valid identifier\n";
+        }
+    }
     else if (args[0] == "exit")
     {
         m_LogFile.close();
+        m_StatusPage.Destroy();
         exit(EXIT_SUCCESS);
     }
     else
@@ -202,16 +428,31 @@ void Shell::WaitForJob(int idx)
     // let fgPID control the terminal fd
     tcsetpgrp(STDIN_FILENO, pid);
 
+    // publish the job now since it may run for a long time
+    m_StatusPage.Publish(m_CurrentJobs);
+
     int status = 0;
-    // here we use waitpid to just keep polling status of the specified child pid
-    // we use WUNTRACED to return if the child process was stopped
-    int wait_pid = waitpid(pid, &status, WUNTRACED);
-    if (wait_pid == pid)
+    struct rusage usage;
+    while (true)
     {
+        if (WaitForChild(pid, 0, status, usage) != pid)
+            break;
+
+        if (WIFCONTINUED(status))
+        {
+            UpdateJobStatus(pid, status, usage);
+            m_LogFile.flush();
+            m_StatusPage.Publish(m_CurrentJobs);
+            continue;
+        }
+
+        idx = GetJobIdxByPID(pid); // other jobs may have been removed meanwhile
+        m_CurrentJobs[idx].SetUsage(usage);
         if (WIFEXITED(status))
         {
             m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_EXITED);
             m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << std::endl;
+            OnJobFinished(idx, status, usage);
             RemoveJob(idx);
         }
         else if (WIFSIGNALED(status))
@@ -222,6 +463,7 @@ void Shell::WaitForJob(int idx)
             putchar('\n');
             m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_TERMINATED);
             m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << std::endl;
+            OnJobFinished(idx, status, usage);
             RemoveJob(idx);
         }
         else if (WIFSTOPPED(status))
@@ -233,9 +475,11 @@ void Shell::WaitForJob(int idx)
             m_CurrentJobs[idx].SetStatus(JobStatus::STATUS_STOPPED);
             m_LogFile << m_CurrentJobs[idx].GetName() << '\t' << m_CurrentJobs[idx].GetStatusString() << std::endl;
         }
+        break;
     }
 
     tcsetpgrp(STDIN_FILENO, getpid()); // restore terminal control to shell
+    m_StatusPage.Publish(m_CurrentJobs);
 }
 
 void Shell::LaunchJob(std::vector<std::string> &args)
@@ -276,50 +520,57 @@ void Shell::LaunchJob(std::vector<std::string> &args)
             int idx = 0;
             std::stringstream ss(std::move(idx_str));
             ss >> idx; // convert the string to an int (parse as an int)
-            if (idx <= (m_CurrentJobs.size() - 1))
+            if (idx < m_CurrentJobs.size())
                 args[i] = std::to_string(m_CurrentJobs[idx].GetPID());
         }
     }
 
-    pid_t pid = fork();
+    // strip the launch modifiers (@cpus=, @nice=, ...) that come before the program name
+    LaunchOptions options;
+    std::string error;
+    if (!options.Parse(args, error))
+    {
+        std::cout << GetName() << ": " << error << '\n';
+        return;
+    }
+    if (args.empty())
+    {
+        std::cout << GetName() << ": no command given after launch options\n";
+        return;
+    }
+
+    if (bIsBackgroundExec && !options.HasAffinity())
+    {
+        cpu_set_t cpus;
+        if (LaunchOptions::GetSpreadAffinity(m_SpreadMode, m_NextSpreadSlot, cpus))
+        {
+            options.SetAffinity(cpus);
+            m_NextSpreadSlot++;
+        }
+    }
+
+    // the log and stats files are only needed once there are jobs
+    OpenJobFiles();
+
+    pid_t pid = ForkChild();
     if (pid == 0)
     {
         // in child process
 
-        // restore default signals behaviour
-        signal(SIGINT, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        signal(SIGTTIN, SIG_DFL);
-        signal(SIGTTOU, SIG_DFL);
-        signal(SIGCHLD, SIG_DFL);
+        RestoreChildSignals();
 
         // set the child pid to be the group leader
         // of its own process group
         setpgid(0, 0);
 
-        /*
-         create an array to hold the args pointers from the vector
-         which clean itself automatically in case execvp fails
-
-         we need extra arg place at the end to contain nullptr so that execvp can deduce args count
-        */
-        auto cargs = std::make_unique<char *[]>(args.size() + 1);
-        for (size_t idx = 0; idx < args.size(); ++idx)
+        if (const char *failedOption = options.Apply())
         {
-            cargs[idx] = &args[idx][0];
+            perror((GetName() + ": " + failedOption).c_str());
+            fflush(stdout);
+            exit(EXIT_FAILURE);
         }
-        cargs[args.size()] = nullptr; // last element in argv array must be null
 
-        if (execvp(cargs[0], cargs.get()) == -1)
-        {
-            perror(GetName().c_str());
-            
-        }
-        // flush immediately so that our error message get printed before the prompt
-        fflush(stdout);
-
-        exit(EXIT_FAILURE);
+        ExecProgram(args);
     }
     else if (pid == -1)
     {
@@ -353,9 +604,379 @@ void Shell::LaunchJob(std::vector<std::string> &args)
     }
 }
 
+void Shell::RestoreChildSignals()
+{
+    // restore default signals behaviour
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    // SIGCHLD is blocked by the shell while launching, and the signal mask survives exec
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
+void Shell::ExecProgram(std::vector<std::string> &args, size_t firstInheritedFd)
+{
+    /*
+     create an array to hold the args pointers from the vector
+     which clean itself automatically in case execvpe fails
+
+     we need extra arg place at the end to contain nullptr so that execvpe can deduce args count
+    */
+    auto cargs = std::make_unique<char *[]>(args.size() + 1);
+    for (size_t idx = 0; idx < args.size(); ++idx)
+    {
+        cargs[idx] = &args[idx][0];
+    }
+    cargs[args.size()] = nullptr; // last element in argv array must be null
+
+    // the substitution pipes (/dev/fd/N args) are the only descriptors of the shell the program should inherit,
+    // a substitution child only gets its own nested ones, the pipes of its siblings must not be kept open by it
+    for (size_t idx = firstInheritedFd; idx < m_SubstitutionFds.size(); ++idx)
+    {
+        fcntl(m_SubstitutionFds[idx], F_SETFD, 0);
+    }
+
+    // the environment of the job is made of the exported variables only
+    if (execvpe(cargs[0], cargs.get(), m_Variables.GetEnvp()) == -1)
+    {
+        perror(GetName().c_str());
+    }
+    // flush immediately so that our error message get printed before the prompt
+    fflush(stdout);
+
+    exit(EXIT_FAILURE);
+}
+
+void Shell::ExecSubstitution(std::vector<std::string> &args, size_t firstInheritedFd)
+{
+    RestoreChildSignals();
+    if (ExecuteBuiltinCommands(args))
+    {
+        // builtins run inside the forked shell and their side effects are lost, like in other shells
+        fflush(stdout);
+        exit(EXIT_SUCCESS);
+    }
+    ExecProgram(args, firstInheritedFd);
+}
+
+bool Shell::IsOutputOnlyBuiltin(const std::string &name)
+{
+    return name == "echo" || name == "pwd" || name == "jobs" || name == "stats";
+}
+
+std::string Shell::CommandSubstitution(const std::string &cmdline)
+{
+    std::vector<std::string> args = Util::TokenizeCommandLine(cmdline);
+    const size_t firstNestedFd = m_SubstitutionFds.size(); // the child only inherits what its own args add
+    ExpandArgs(args);
+    if (args.empty())
+        return {};
+
+    std::string output;
+    if (IsOutputOnlyBuiltin(args[0]))
+    {
+        // no need to fork, run the builtin in-process with stdout redirected into a memory file
+        int memfd = memfd_create("cshell-substitution", MFD_CLOEXEC);
+        if (memfd == -1)
+        {
+            perror(GetName().c_str());
+            return {};
+        }
+        fflush(stdout);
+        int savedStdout = dup(STDOUT_FILENO);
+        dup2(memfd, STDOUT_FILENO);
+        ExecuteBuiltinCommands(args);
+        fflush(stdout);
+        dup2(savedStdout, STDOUT_FILENO);
+        close(savedStdout);
+
+        lseek(memfd, 0, SEEK_SET);
+        output = Util::ReadAll(memfd);
+        close(memfd);
+    }
+    else
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1)
+        {
+            perror(GetName().c_str());
+            return {};
+        }
+
+        pid_t pid = ForkChild();
+        if (pid == 0)
+        {
+            dup2(fds[1], STDOUT_FILENO);
+            ExecSubstitution(args, firstNestedFd);
+        }
+        close(fds[1]);
+        if (pid == -1)
+        {
+            perror(GetName().c_str());
+            close(fds[0]);
+            return {};
+        }
+
+        output = ReadSubstitutionOutput(fds[0], pid);
+        close(fds[0]);
+    }
+
+    // trailing newlines are removed like in other shells
+    const auto lastChar = output.find_last_not_of('\n');
+    output.resize(lastChar == std::string::npos ? 0 : lastChar + 1);
+    return output;
+}
+
+std::string Shell::ReadSubstitutionOutput(int fd, pid_t pid)
+{
+    // SIGCHLD is blocked while parsing, so a signalfd tells us when children change status
+    // and the other jobs are kept up to date while $(...) runs, like WaitForJob does
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    int sigFd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    std::string output;
+    int status;
+    struct rusage usage;
+    bool bReaped = false;
+    while (true)
+    {
+        struct pollfd pfds[2] = {{fd, POLLIN, 0}, {sigFd, POLLIN, 0}};
+        if (poll(pfds, sigFd != -1 ? 2 : 1, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfds[0].revents)
+        {
+            char buffer[4096];
+            const ssize_t size = read(fd, buffer, sizeof(buffer));
+            if (size == -1 && errno == EINTR)
+                continue;
+            if (size <= 0)
+                break;
+            output.append(buffer, size);
+        }
+
+        if (sigFd != -1 && pfds[1].revents)
+        {
+            struct signalfd_siginfo info;
+            while (read(sigFd, &info, sizeof(info)) == sizeof(info))
+                ; // the pending SIGCHLDs are all handled by the loop below
+            while (WaitForChild(pid, WNOHANG, status, usage) == pid)
+            {
+                if (WIFEXITED(status) || WIFSIGNALED(status))
+                    bReaped = true;
+            }
+        }
+    }
+    if (sigFd != -1)
+        close(sigFd);
+
+    // the child isn't a job, so we wait for it till it's gone
+    while (!bReaped && WaitForChild(pid, 0, status, usage) == pid)
+        bReaped = (WIFEXITED(status) || WIFSIGNALED(status));
+    return output;
+}
+
+std::string Shell::ProcessSubstitution(const std::string &cmdline, bool bIsInput)
+{
+    std::vector<std::string> args = Util::TokenizeCommandLine(cmdline);
+    const size_t firstNestedFd = m_SubstitutionFds.size(); // the child only inherits what its own args add
+    ExpandArgs(args);
+    if (args.empty())
+        return {};
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror(GetName().c_str());
+        return {};
+    }
+
+    // for <(...) the job reads what the child writes, for >(...) it's the other way around
+    const int childFd = bIsInput ? fds[1] : fds[0];
+    const int shellFd = bIsInput ? fds[0] : fds[1];
+
+    pid_t pid = ForkChild();
+    if (pid == 0)
+    {
+        dup2(childFd, bIsInput ? STDOUT_FILENO : STDIN_FILENO);
+        ExecSubstitution(args, firstNestedFd);
+    }
+    close(childFd);
+    if (pid == -1)
+    {
+        perror(GetName().c_str());
+        close(shellFd);
+        return {};
+    }
+
+    // the child isn't a job, it gets reaped by the SIGCHLD handler once it's done
+    m_SubstitutionFds.push_back(shellFd);
+    return "/dev/fd/" + std::to_string(shellFd);
+}
+
+std::string Shell::ExpandWord(const std::string &word, bool &bNeedsSplitting)
+{
+    if (word.find_first_of("$<>") == std::string::npos)
+        return word; // nothing to expand
+
+    std::string result;
+    size_t i = 0;
+    while (i < word.size())
+    {
+        const char c = word[i];
+        const char next = (i + 1 < word.size()) ? word[i + 1] : '\0';
+        if ((c == '$' || c == '<' || c == '>') && next == '(')
+        {
+            const size_t end = Util::FindClosingParen(word, i + 1);
+            if (end != std::string::npos)
+            {
+                const std::string cmdline = word.substr(i + 2, end - i - 2);
+                if (c == '$')
+                {
+                    result += CommandSubstitution(cmdline);
+                    bNeedsSplitting = true;
+                }
+                else
+                {
+                    result += ProcessSubstitution(cmdline, c == '<');
+                }
+                i = end + 1;
+                continue;
+            }
+        }
+        else if (c == '$' && next == '{')
+        {
+            // ${NAME}
+            const size_t end = word.find('}', i + 2);
+            const std::string name = (end != std::string::npos) ? word.substr(i + 2, end - i - 2) : "";
+            if (Variables::IsValidName(name))
+            {
+                if (const std::string *value = m_Variables.Get(name))
+                    result += *value;
+                bNeedsSplitting = true;
+                i = end + 1;
+                continue;
+            }
+        }
+        else if (c == '$')
+        {
+            // $NAME
+            const size_t nameLength = Variables::GetNameLength(word, i + 1);
+            if (nameLength != 0)
+            {
+                if (const std::string *value = m_Variables.Get(word.substr(i + 1, nameLength)))
+                    result += *value;
+                bNeedsSplitting = true;
+                i += 1 + nameLength;
+                continue;
+            }
+        }
+        result += c;
+        i++;
+    }
+    return result;
+}
+
+void Shell::ExpandArgs(std::vector<std::string> &args)
+{
+    // the NAME=value args of export are expanded like assignments, so their values are never split
+    const bool bIsExport = (!args.empty() && args[0] == "export");
+
+    std::vector<std::string> expanded;
+    expanded.reserve(args.size());
+    for (const auto &arg : args)
+    {
+        bool bNeedsSplitting = false;
+        std::string result = ExpandWord(arg, bNeedsSplitting);
+        if (bNeedsSplitting && bIsExport && IsAssignment(arg))
+            bNeedsSplitting = false;
+
+        if (bNeedsSplitting)
+        {
+            // the expanded values are split into separate args on whitespace
+            for (auto &word : Util::Tokenize(result, " \t\n"))
+                expanded.push_back(std::move(word));
+        }
+        else if (!result.empty())
+        {
+            expanded.push_back(std::move(result));
+        }
+    }
+    args = std::move(expanded);
+}
+
+bool Shell::IsAssignment(const std::string &arg)
+{
+    const auto separator = arg.find('=');
+    return separator != std::string::npos && Variables::IsValidName(arg.substr(0, separator));
+}
+
+bool Shell::ExecuteAssignments(const std::vector<std::string> &args)
+{
+    for (const auto &arg : args)
+    {
+        if (!IsAssignment(arg))
+            return false; // not just assignments, it's a command
+    }
+
+    for (const auto &arg : args)
+    {
+        const auto separator = arg.find('=');
+        bool bNeedsSplitting = false; // values of assignments are never split
+        m_Variables.Set(arg.substr(0, separator), ExpandWord(arg.substr(separator + 1), bNeedsSplitting));
+    }
+    return true;
+}
+
+pid_t Shell::ForkChild()
+{
+    // make sure the cached envp is up to date before forking
+    // so that it's rebuilt once in the shell rather than in every child
+    m_Variables.GetEnvp();
+    return fork();
+}
+
+void Shell::CloseSubstitutionFds()
+{
+    for (int fd : m_SubstitutionFds)
+    {
+        close(fd);
+    }
+    m_SubstitutionFds.clear();
+}
+
+void Shell::OnJobFinished(int idx, int status, const struct rusage &usage)
+{
+    const auto &job = m_CurrentJobs[idx];
+    const bool bFailed = WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+
+    const auto wallTime = std::chrono::steady_clock::now() - job.GetStartTime();
+    const uint64_t wallTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(wallTime).count();
+    const uint64_t cpuTimeUs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+                               usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+    m_JobStats.Record(job.GetName().c_str(), bFailed, wallTimeUs, cpuTimeUs);
+    m_StatusPage.AddFinished(job, status);
+}
+
 int Shell::ParseJobIndex(const std::vector<std::string> &args)
 {
-    int idx;
+    int idx = -1;
     if (args[1].find_first_of('%') == std::string::npos)
         return -1; // if % can't be found then it's a syntax error
 
@@ -369,7 +990,7 @@ int Shell::ParseJobIndex(const std::vector<std::string> &args)
     {
         std::stringstream ss(idx_str);
         ss >> idx; // convert the string to an int (parse as an int)
-        if (idx > (m_CurrentJobs.size() - 1))
+        if (ss.fail() || static_cast<size_t>(idx) >= m_CurrentJobs.size())
             return -1;
     }
     else
@@ -8,25 +8,43 @@
 #include <fstream>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <cstdio>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <wait.h>
 #include <pwd.h>
 #include <termios.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <poll.h>
 #include "Util.hpp"
 #include "Job.hpp"
 #include "CMD.hpp"
+#include "JobStats.hpp"
+#include "LaunchOptions.hpp"
+#include "Variables.hpp"
+#include "RcFile.hpp"
+#include "JobStatusPage.hpp"
 
 class Shell
 {
     std::ofstream m_LogFile;
+    bool m_bJobFilesOpened = false; // the log and stats files are opened on first use
     const std::string m_ShellName = "cshell";
-    std::string m_PrevWorkingDir;   // previous working directory
-    std::string m_CurrUsername;     // current logged in user name
+    std::string m_PrevWorkingDir;   // previous working directory (empty till the first cd)
+    std::string m_CurrUsername;     // current logged in user name (looked up on first use)
     std::vector<Job> m_CurrentJobs; // current jobs launched by shell
+    JobStats m_JobStats;            // per-command aggregates persisted across sessions
+    JobStatusPage m_StatusPage;     // job table published in shared memory for monitors
+    SpreadMode m_SpreadMode = SpreadMode::OFF;
+    size_t m_NextSpreadSlot = 0; // round-robin position used when spreading background jobs
+    Variables m_Variables;          // shell variables, exported ones make up the environment of jobs
+    std::vector<int> m_SubstitutionFds; // shell ends of the <(...) and >(...) pipes of the current command
 
     std::string ReadLine();
 
@@ -37,17 +55,68 @@ class Shell
 
     void LaunchJob(std::vector<std::string> &args);
 
+    // resets signal handling of a forked child to the defaults before it execs
+    void RestoreChildSignals();
+
+    // execs args[0] in the current (forked) process, never returns
+    // firstInheritedFd : index of the first of m_SubstitutionFds that belongs to args
+    [[noreturn]] void ExecProgram(std::vector<std::string> &args, size_t firstInheritedFd = 0);
+
+    // runs args in the forked child of a substitution, builtins included, never returns
+    // firstInheritedFd : index of the first of m_SubstitutionFds added by the nested substitutions of args
+    [[noreturn]] void ExecSubstitution(std::vector<std::string> &args, size_t firstInheritedFd);
+
+    // builtins that only print and can run inside $(...) without forking
+    static bool IsOutputOnlyBuiltin(const std::string &name);
+
+    // expands variables and substitutions in word
+    // bNeedsSplitting is set to true if the result should be split into separate args
+    std::string ExpandWord(const std::string &word, bool &bNeedsSplitting);
+
+    void ExpandArgs(std::vector<std::string> &args);
+
+    // returns true if arg has the NAME=value form
+    static bool IsAssignment(const std::string &arg);
+
+    // returns false if args aren't all NAME=value assignments
+    bool ExecuteAssignments(const std::vector<std::string> &args);
+
+    // forks after making sure the cached envp is ready to be used by the child
+    pid_t ForkChild();
+
+    // runs cmdline and returns its output with trailing newlines removed
+    std::string CommandSubstitution(const std::string &cmdline);
+
+    // reads the output of the $(...) child pid from fd till EOF and reaps it
+    std::string ReadSubstitutionOutput(int fd, pid_t pid);
+
+    // runs cmdline connected to a pipe and returns the /dev/fd/N path of the shell end
+    // bIsInput : if true cmdline writes into the pipe <(...), otherwise it reads from it >(...)
+    std::string ProcessSubstitution(const std::string &cmdline, bool bIsInput);
+
+    void CloseSubstitutionFds();
+
+    // records stats of job idx which has just exited or got terminated and publishes it as finished
+    void OnJobFinished(int idx, int status, const struct rusage &usage);
+
     void PrintPrompt()
     {
 #define COLOR_BOLD_GREEN "\033[1;32m"
 #define COLOR_NONE "\033[0m"
 
         printf(COLOR_BOLD_GREEN "%s" COLOR_NONE " >> ",
-               m_CurrUsername.c_str());
+               GetUsername().c_str());
     }
 
+    // opens the log and stats files and the status page, done once before the first job is launched
+    void OpenJobFiles();
+
+    const std::string &GetUsername();
+
 public:
-    Shell();
+    // sets up signals, terminal control and runs ~/.cshellrc
+    // bProfileStartup : if true the time spent in each step is printed to stderr
+    void Init(bool bProfileStartup);
 
     void Run();
 
@@ -75,8 +144,11 @@ public:
         m_PrevWorkingDir = std::move(Dir);
     }
 
-    const std::string &GetPrevWorkingDir()
+    std::string GetPrevWorkingDir()
     {
+        // till the first cd the previous working directory is the current one
+        if (m_PrevWorkingDir.empty())
+            return GetCurrWorkingDir();
         return m_PrevWorkingDir;
     }
 
@@ -85,8 +157,46 @@ public:
         return m_CurrentJobs;
     }
 
+    JobStats &GetJobStats()
+    {
+        OpenJobFiles();
+        return m_JobStats;
+    }
+
+    Variables &GetVariables()
+    {
+        return m_Variables;
+    }
+
+    SpreadMode GetSpreadMode() const
+    {
+        return m_SpreadMode;
+    }
+
+    void SetSpreadMode(SpreadMode mode)
+    {
+        m_SpreadMode = mode;
+        m_NextSpreadSlot = 0;
+    }
+
     void UpdateJobsStatus();
 
+    // removes the status page, used when the shell gets terminated by a signal
+    void RemoveStatusPage()
+    {
+        m_StatusPage.Unlink();
+    }
+
+    // updates the job of pid according to status reported by wait4
+    // returns true if the job has finished and should be removed by RemoveFinishedJobs
+    bool UpdateJobStatus(pid_t pid, int status, const struct rusage &usage);
+
+    void RemoveFinishedJobs();
+
+    // waits (with wait4 options) till pid changes status, updating the other jobs that change meanwhile
+    // returns pid, or 0 / -1 like wait4 does with WNOHANG / on errors
+    pid_t WaitForChild(pid_t pid, int options, int &status, struct rusage &usage);
+
     void RemoveJob(int idx)
     {
         m_CurrentJobs.erase(m_CurrentJobs.begin() + idx);
@@ -105,12 +215,22 @@ public:
         return -1; // not found
     }
 
-    void PrintJobStatus(int idx, bool bPrintStatus = true)
+    // bPrintCPUs : if true the cpus the job is currently bound to are printed too
+    void PrintJobStatus(int idx, bool bPrintStatus = true, bool bPrintCPUs = false)
     {
         const auto &job = m_CurrentJobs[idx];
         if (bPrintStatus)
         {
-            printf("[%d]\t%d\t%s\t\t%s ", idx, job.GetPID(), job.GetStatusString(), job.GetName().c_str());
+            printf("[%d]\t%d\t%s\t", idx, job.GetPID(), job.GetStatusString());
+            if (bPrintCPUs)
+            {
+                cpu_set_t cpus;
+                if (sched_getaffinity(job.GetPID(), sizeof(cpus), &cpus) == 0)
+                    printf("cpus=%s\t", Util::FormatCPUList(cpus).c_str());
+                else
+                    printf("cpus=?\t");
+            }
+            printf("\t%s ", job.GetName().c_str());
             if (job.GetExecType() == ExecutionType::BACKGROUND)
                 putchar('&'); // puts & after the name if it's a background process
             putchar('\n');
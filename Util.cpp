@@ -1,4 +1,9 @@
 #include "Util.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <unistd.h>
 
 namespace Util {
     std::vector<std::string> Tokenize(const std::string &str, const std::string &delim) {
@@ -19,4 +24,127 @@ namespace Util {
         }
         return parts;
     }
-}
\ No newline at end of file
+
+    std::vector<std::string> TokenizeCommandLine(const std::string &line) {
+        std::vector<std::string> parts;
+        std::string current;
+        int depth = 0; // how many substitution groups we are inside
+        for (size_t i = 0; i < line.size(); ++i) {
+            const char c = line[i];
+            if (depth == 0 && (c == ' ' || c == '\t' || c == '\n')) {
+                if (!current.empty())
+                    parts.push_back(std::move(current));
+                current.clear();
+                continue;
+            }
+
+            if (c == '(' && (depth > 0 || (i > 0 && (line[i - 1] == '$' || line[i - 1] == '<' || line[i - 1] == '>'))))
+                depth++;
+            else if (c == ')' && depth > 0)
+                depth--;
+            current += c;
+        }
+        if (!current.empty())
+            parts.push_back(std::move(current));
+        return parts;
+    }
+
+    size_t FindClosingParen(const std::string &str, size_t openPos) {
+        int depth = 0;
+        for (size_t i = openPos; i < str.size(); ++i) {
+            if (str[i] == '(')
+                depth++;
+            else if (str[i] == ')' && --depth == 0)
+                return i;
+        }
+        return std::string::npos;
+    }
+
+    std::string ReadAll(int fd) {
+        // read straight into the string and grow it geometrically,
+        // so that multi-megabyte outputs don't get copied over and over
+        const size_t initialSize = 64 * 1024;
+        std::string data(initialSize, '\0');
+        size_t used = 0;
+        while (true) {
+            if (used == data.size())
+                data.resize(data.size() * 2);
+
+            const ssize_t count = read(fd, &data[used], data.size() - used);
+            if (count > 0)
+                used += count;
+            else if (count == -1 && errno == EINTR)
+                continue;
+            else
+                break; // EOF or error
+        }
+        data.resize(used);
+        return data;
+    }
+
+    std::string EscapeJson(const std::string &str) {
+        std::string escaped;
+        escaped.reserve(str.size());
+        for (const char c : str) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buffer[8];
+                snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                escaped += buffer;
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    bool ParseCPUList(const std::string &str, cpu_set_t &cpus) {
+        // strtoul on its own would accept leading spaces and signs ("-1" wraps around),
+        // so a number must start with a digit and the end pointer tells where the range goes on
+        auto ParseCPU = [](const char *number, const char *&end, unsigned long &cpu) {
+            if (!isdigit(static_cast<unsigned char>(*number)))
+                return false;
+            char *numberEnd = nullptr;
+            errno = 0;
+            cpu = strtoul(number, &numberEnd, 10);
+            end = numberEnd;
+            return errno == 0 && cpu < CPU_SETSIZE;
+        };
+
+        CPU_ZERO(&cpus);
+        for (const auto &range : Tokenize(str, ",\n")) {
+            const char *end;
+            unsigned long first, last;
+            if (!ParseCPU(range.c_str(), end, first))
+                return false;
+            last = first;
+            if (*end == '-' && !ParseCPU(end + 1, end, last))
+                return false;
+            if (*end != '\0' || first > last)
+                return false; // trailing junk like "3x"
+            for (unsigned long cpu = first; cpu <= last; ++cpu)
+                CPU_SET(cpu, &cpus);
+        }
+        return CPU_COUNT(&cpus) > 0;
+    }
+
+    std::string FormatCPUList(const cpu_set_t &cpus) {
+        std::string list;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &cpus))
+                continue;
+            int last = cpu;
+            while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus))
+                last++;
+            if (!list.empty())
+                list += ',';
+            list += std::to_string(cpu);
+            if (last != cpu)
+                list += '-' + std::to_string(last);
+            cpu = last;
+        }
+        return list;
+    }
+}
@@ -2,7 +2,50 @@
 
 #include <vector>
 #include <string>
+#include <csignal>
+#include <sched.h>
 
 namespace Util {
     std::vector<std::string> Tokenize(const std::string &str, const std::string &delim);
+
+    // splits a command line on whitespace, keeping $(...), <(...) and >(...) groups
+    // (which may contain whitespace and nested groups) inside a single token
+    std::vector<std::string> TokenizeCommandLine(const std::string &line);
+
+    // returns the position of the ')' matching the '(' at openPos or npos if it's unbalanced
+    size_t FindClosingParen(const std::string &str, size_t openPos);
+
+    // reads everything from fd till EOF
+    std::string ReadAll(int fd);
+
+    // escapes str to be used inside a JSON string
+    std::string EscapeJson(const std::string &str);
+
+    // parses a cpu list like "0-3,8,10-11" (as used by taskset and sysfs)
+    // returns false if the list is malformed or empty
+    bool ParseCPUList(const std::string &str, cpu_set_t &cpus);
+
+    // formats cpus back into a list like "0-3,8,10-11"
+    std::string FormatCPUList(const cpu_set_t &cpus);
+
+    // blocks the delivery of signal for the lifetime of the object
+    // and restores the previous signal mask when it goes out of scope
+    class ScopedSignalBlock {
+        sigset_t m_OldMask;
+
+    public:
+        explicit ScopedSignalBlock(int signal) {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, signal);
+            sigprocmask(SIG_BLOCK, &mask, &m_OldMask);
+        }
+
+        ScopedSignalBlock(const ScopedSignalBlock &) = delete;
+        ScopedSignalBlock &operator=(const ScopedSignalBlock &) = delete;
+
+        ~ScopedSignalBlock() {
+            sigprocmask(SIG_SETMASK, &m_OldMask, nullptr);
+        }
+    };
 }
@@ -0,0 +1,114 @@
+#include "Variables.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+
+void Variables::Import(char **envp)
+{
+    for (; envp && *envp; ++envp)
+    {
+        const std::string entry = *envp;
+        const auto separator = entry.find('=');
+        if (separator == std::string::npos)
+            continue;
+        m_Variables[entry.substr(0, separator)] = {entry.substr(separator + 1), true};
+    }
+    m_bEnvpDirty = true;
+}
+
+const std::string *Variables::Get(const std::string &name) const
+{
+    const auto it = m_Variables.find(name);
+    return it != m_Variables.end() ? &it->second.m_Value : nullptr;
+}
+
+void Variables::Set(const std::string &name, const std::string &value)
+{
+    auto &var = m_Variables[name]; // a new variable is value-initialized as local
+    var.m_Value = value;
+    if (var.m_bExported)
+        OnExportedChanged(name, &var);
+}
+
+void Variables::Export(const std::string &name)
+{
+    auto &var = m_Variables[name];
+    if (var.m_bExported)
+        return;
+    var.m_bExported = true;
+    OnExportedChanged(name, &var);
+}
+
+void Variables::Unset(const std::string &name)
+{
+    const auto it = m_Variables.find(name);
+    if (it == m_Variables.end())
+        return;
+    const bool bWasExported = it->second.m_bExported;
+    m_Variables.erase(it);
+    if (bWasExported)
+        OnExportedChanged(name, nullptr);
+}
+
+void Variables::OnExportedChanged(const std::string &name, const Variable *var)
+{
+    m_bEnvpDirty = true;
+
+    // execvpe looks up the program in the PATH of the shell itself rather than in envp
+    // so PATH is also kept in sync with the real environment of the shell
+    if (name == "PATH")
+    {
+        if (var && var->m_bExported)
+            setenv("PATH", var->m_Value.c_str(), 1);
+        else
+            unsetenv("PATH");
+    }
+}
+
+char *const *Variables::GetEnvp()
+{
+    if (m_bEnvpDirty)
+    {
+        m_EnvStorage.clear();
+        for (const auto &var : m_Variables)
+        {
+            if (var.second.m_bExported)
+                m_EnvStorage.push_back(var.first + '=' + var.second.m_Value);
+        }
+
+        // the pointers are taken once all strings are in place since push_back may reallocate
+        m_Envp.clear();
+        m_Envp.reserve(m_EnvStorage.size() + 1);
+        for (auto &entry : m_EnvStorage)
+            m_Envp.push_back(&entry[0]);
+        m_Envp.push_back(nullptr); // envp must be null terminated
+
+        m_bEnvpDirty = false;
+    }
+    return m_Envp.data();
+}
+
+void Variables::PrintExported() const
+{
+    for (const auto &var : m_Variables)
+    {
+        if (var.second.m_bExported)
+            printf("export %s=%s\n", var.first.c_str(), var.second.m_Value.c_str());
+    }
+}
+
+bool Variables::IsValidName(const std::string &name)
+{
+    return !name.empty() && GetNameLength(name) == name.size();
+}
+
+size_t Variables::GetNameLength(const std::string &str, size_t pos)
+{
+    if (pos >= str.size() || !(isalpha(static_cast<unsigned char>(str[pos])) || str[pos] == '_'))
+        return 0;
+
+    size_t end = pos + 1;
+    while (end < str.size() && (isalnum(static_cast<unsigned char>(str[end])) || str[end] == '_'))
+        end++;
+    return end - pos;
+}
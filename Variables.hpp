@@ -0,0 +1,53 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+    shell variables, either local to the shell or exported to the jobs it launches.
+
+    the envp array handed to exec is built once and cached,
+    it only gets rebuilt after an exported variable has changed.
+*/
+class Variables
+{
+    struct Variable
+    {
+        std::string m_Value;
+        bool m_bExported;
+    };
+
+    std::map<std::string, Variable> m_Variables;
+    std::vector<std::string> m_EnvStorage; // "NAME=value" strings m_Envp points into
+    std::vector<char *> m_Envp;
+    bool m_bEnvpDirty = true;
+
+    void OnExportedChanged(const std::string &name, const Variable *var);
+
+public:
+    // imports every NAME=value of envp as an exported variable
+    void Import(char **envp);
+
+    // returns nullptr if the variable isn't set
+    const std::string *Get(const std::string &name) const;
+
+    // sets the value keeping the variable exported if it already was
+    void Set(const std::string &name, const std::string &value);
+
+    // marks the variable as exported (creating it empty if it isn't set)
+    void Export(const std::string &name);
+
+    void Unset(const std::string &name);
+
+    // returns the null terminated envp array of the exported variables
+    char *const *GetEnvp();
+
+    // prints the exported variables in a form that can be used as input again
+    void PrintExported() const;
+
+    // returns true if name is a valid variable name ([A-Za-z_][A-Za-z0-9_]*)
+    static bool IsValidName(const std::string &name);
+
+    // returns the length of the valid variable name at the start of str
+    static size_t GetNameLength(const std::string &str, size_t pos = 0);
+};
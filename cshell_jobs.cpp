@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <vector>
+#include "JobStatusPage.hpp"
+
+// reads the job status pages published by running cshell instances
+// usage: cshell-jobs [--json] [shell_pid ...]
+
+namespace
+{
+void PrintText(const JobStatusSnapshot &snapshot)
+{
+    // a shell that got killed can't remove its page
+    const bool bIsRunning = (kill(snapshot.m_ShellPid, 0) == 0 || errno != ESRCH);
+    printf("cshell %d%s: %zu job(s)%s\n", snapshot.m_ShellPid, bIsRunning ? "" : " (not running)",
+           snapshot.m_Jobs.size(), snapshot.m_bTruncated ? " (truncated)" : "");
+
+    for (const auto &entry : snapshot.m_Jobs)
+    {
+        printf("[%d]\t%d\t%s\t\t%.*s ", entry.m_JobIdx, entry.m_Pid,
+               Job::GetStatusString(static_cast<JobStatus>(entry.m_Status)),
+               static_cast<int>(sizeof(entry.m_Name)), entry.m_Name);
+        if (static_cast<ExecutionType>(entry.m_ExecType) == ExecutionType::BACKGROUND)
+            putchar('&');
+        putchar('\n');
+    }
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    bool bJson = false;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            bJson = true;
+        else if (strspn(argv[i], "0123456789") == strlen(argv[i]) && argv[i][0] != '\0')
+            names.push_back(JobStatusPage::GetName(atoi(argv[i])));
+        else
+        {
+            fprintf(stderr, "usage: %s [--json] [shell_pid ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const bool bListAll = names.empty();
+    if (bListAll)
+        names = JobStatusPage::List();
+
+    int result = EXIT_SUCCESS;
+    for (const auto &name : names)
+    {
+        JobStatusSnapshot snapshot;
+        if (!JobStatusPage::Read(name, snapshot))
+        {
+            if (!bListAll)
+            {
+                fprintf(stderr, "%s: no status page %s\n", argv[0], name.c_str());
+                result = EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        if (bJson)
+            JobStatusPage::PrintJson(stdout, snapshot);
+        else
+            PrintText(snapshot);
+    }
+    return result;
+}
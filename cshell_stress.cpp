@@ -0,0 +1,579 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <functional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "JobStatusPage.hpp"
+
+// drives cshell through a pseudo terminal the way a user would and checks that its job table stays consistent
+// usage: cshell-stress [-n background_jobs] [-c cycles] [-s cshell_path]
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// the prompt of the shell, the user name is fixed by the $USER we start it with
+const char *PROMPT_USER = "stress";
+const char *PROMPT_MARKER = "\033[1;32mstress\033[0m >> ";
+const int PROMPT_TIMEOUT_MS = 10 * 1000;
+
+double GetElapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double GetPercentile(std::vector<double> samples, double percentile)
+{
+    if (samples.empty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    const size_t rank = static_cast<size_t>(percentile / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[rank];
+}
+
+std::string FormatLatency(const std::vector<double> &samples)
+{
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "p50 %.3fms p99 %.3fms max %.3fms", GetPercentile(samples, 50),
+             GetPercentile(samples, 99), GetPercentile(samples, 100));
+    return buffer;
+}
+
+// reads the state and parent of pid from /proc, returns false if it doesn't exist anymore
+bool ReadProcStat(pid_t pid, char &state, pid_t &parentPid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char buffer[512];
+    const size_t size = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[size] = '\0';
+
+    // the command name is in parentheses and may contain spaces
+    const char *nameEnd = strrchr(buffer, ')');
+    return nameEnd && sscanf(nameEnd + 1, " %c %d", &state, &parentPid) == 2;
+}
+
+std::string ReadComm(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return "";
+
+    char buffer[64] = {};
+    if (!fgets(buffer, sizeof(buffer), file))
+        buffer[0] = '\0';
+    fclose(file);
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return buffer;
+}
+
+// pids of all the children of parentPid
+std::vector<pid_t> GetChildren(pid_t parentPid)
+{
+    std::vector<pid_t> children;
+    if (DIR *dir = opendir("/proc"))
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            const pid_t pid = atoi(entry->d_name);
+            char state;
+            pid_t ppid;
+            if (pid > 0 && ReadProcStat(pid, state, ppid) && ppid == parentPid)
+                children.push_back(pid);
+        }
+        closedir(dir);
+    }
+    return children;
+}
+
+// removes the work directory along with the fifo and the log/stats files the shell wrote into it
+void RemoveDirectory(const std::string &path)
+{
+    if (DIR *dir = opendir(path.c_str()))
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+                unlink((path + '/' + entry->d_name).c_str());
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
+
+// a cshell instance running on the slave side of a pseudo terminal
+class ShellSession
+{
+    pid_t m_Pid = -1;
+    int m_MasterFd = -1;
+    std::string m_Output;     // received but not consumed yet
+    std::string m_LastOutput; // everything printed before the last prompt
+
+public:
+    ~ShellSession()
+    {
+        Kill();
+    }
+
+    pid_t GetPID() const
+    {
+        return m_Pid;
+    }
+
+    const std::string &GetLastOutput() const
+    {
+        return m_LastOutput;
+    }
+
+    bool Start(const std::string &shellPath, const std::string &home)
+    {
+        m_Pid = forkpty(&m_MasterFd, nullptr, nullptr, nullptr);
+        if (m_Pid == -1)
+            return false;
+
+        if (m_Pid == 0)
+        {
+            // an empty home keeps the rc file of the user out of the measurements
+            // and $USER spares the shell a passwd lookup
+            setenv("HOME", home.c_str(), 1);
+            setenv("USER", PROMPT_USER, 1);
+            // the stress jobs must not end up in the stats and log next to the binary
+            setenv("CSHELL_DATA_DIR", home.c_str(), 1);
+            if (chdir(home.c_str()) == -1)
+                _exit(EXIT_FAILURE);
+            execl(shellPath.c_str(), shellPath.c_str(), static_cast<char *>(nullptr));
+            _exit(127);
+        }
+        return WaitForPrompt();
+    }
+
+    // reads whatever the shell printed, waiting at most timeoutMs for it
+    // returns false once the shell closed the terminal
+    bool Drain(int timeoutMs)
+    {
+        struct pollfd pfd = {m_MasterFd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) <= 0)
+            return true;
+
+        char buffer[64 * 1024];
+        const ssize_t size = read(m_MasterFd, buffer, sizeof(buffer));
+        if (size <= 0)
+            return false;
+        m_Output.append(buffer, size);
+        return true;
+    }
+
+    void Send(const std::string &text)
+    {
+        const char *data = text.data();
+        size_t left = text.size();
+        while (left > 0)
+        {
+            const ssize_t written = write(m_MasterFd, data, left);
+            if (written == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            data += written;
+            left -= written;
+        }
+    }
+
+    // waits for the next prompt and consumes the output up to it
+    bool WaitForPrompt(int timeoutMs = PROMPT_TIMEOUT_MS)
+    {
+        const auto start = Clock::now();
+        while (true)
+        {
+            const size_t pos = m_Output.find(PROMPT_MARKER);
+            if (pos != std::string::npos)
+            {
+                m_LastOutput = m_Output.substr(0, pos);
+                m_Output.erase(0, pos + strlen(PROMPT_MARKER));
+                return true;
+            }
+
+            const int leftMs = timeoutMs - static_cast<int>(GetElapsedMs(start));
+            if (leftMs <= 0 || !Drain(leftMs))
+                return false;
+        }
+    }
+
+    bool ReadPage(JobStatusSnapshot &snapshot) const
+    {
+        return JobStatusPage::Read(JobStatusPage::GetName(m_Pid), snapshot);
+    }
+
+    // polls the status page till condition holds, draining the terminal meanwhile so the shell never blocks on it
+    bool WaitForPage(const std::function<bool(const JobStatusSnapshot &)> &condition, int timeoutMs, JobStatusSnapshot &snapshot)
+    {
+        const auto start = Clock::now();
+        while (GetElapsedMs(start) < timeoutMs)
+        {
+            if (ReadPage(snapshot) && condition(snapshot))
+                return true;
+            if (!Drain(1))
+                return false;
+        }
+        return false;
+    }
+
+    bool IsPromptPending()
+    {
+        Drain(0);
+        return m_Output.find(PROMPT_MARKER) != std::string::npos;
+    }
+
+    int GetForegroundGroup() const
+    {
+        return tcgetpgrp(m_MasterFd);
+    }
+
+    // asks the shell to exit, returns false if it didn't exit in time
+    bool Exit()
+    {
+        Send("exit\n");
+        const auto start = Clock::now();
+        while (GetElapsedMs(start) < PROMPT_TIMEOUT_MS)
+        {
+            int status;
+            if (waitpid(m_Pid, &status, WNOHANG) == m_Pid)
+            {
+                m_Pid = -1;
+                return true;
+            }
+            Drain(10);
+        }
+        return false;
+    }
+
+    void Kill()
+    {
+        if (m_Pid > 0)
+        {
+            for (pid_t child : GetChildren(m_Pid))
+                kill(child, SIGKILL);
+            kill(m_Pid, SIGKILL);
+            waitpid(m_Pid, nullptr, 0);
+            shm_unlink(JobStatusPage::GetName(m_Pid).c_str());
+            m_Pid = -1;
+        }
+        if (m_MasterFd != -1)
+        {
+            close(m_MasterFd);
+            m_MasterFd = -1;
+        }
+    }
+};
+
+struct Options
+{
+    int m_BackgroundJobs = 10000;
+    int m_Cycles = 100;
+    std::string m_ShellPath;
+};
+
+bool Report(bool bPassed, const char *scenario, const std::string &details)
+{
+    printf("[%s] %-24s %s\n", bPassed ? "PASS" : "FAIL", scenario, details.c_str());
+    fflush(stdout);
+    return bPassed;
+}
+
+// the output of a command without the echoed command line
+std::string GetCommandOutput(const std::string &output)
+{
+    const size_t lineEnd = output.find('\n');
+    return lineEnd == std::string::npos ? "" : output.substr(lineEnd + 1);
+}
+
+// launches the given count of background jobs which then exit all at once
+bool RunBackgroundExits(ShellSession &session, const std::string &workDir, int jobCount)
+{
+    const char *scenario = "background exits";
+    const std::string fifoPath = workDir + "/release";
+    if (mkfifo(fifoPath.c_str(), 0600) == -1)
+        return Report(false, scenario, std::string("mkfifo: ") + strerror(errno));
+
+    // every cat blocks opening the fifo till we open it for writing
+    std::vector<double> launchLatencies;
+    for (int i = 0; i < jobCount; ++i)
+    {
+        const auto start = Clock::now();
+        session.Send("cat " + fifoPath + " &\n");
+        if (!session.WaitForPrompt())
+            return Report(false, scenario, "no prompt after launching job " + std::to_string(i));
+        launchLatencies.push_back(GetElapsedMs(start));
+        if (session.GetLastOutput().find('[') == std::string::npos)
+            return Report(false, scenario, "job " + std::to_string(i) + " wasn't launched: " + session.GetLastOutput());
+    }
+
+    JobStatusSnapshot snapshot;
+    const size_t expectedCount = std::min<size_t>(jobCount, static_cast<size_t>(JobStatusPage::MAX_JOBS));
+    if (!session.ReadPage(snapshot) || snapshot.m_Jobs.size() != expectedCount ||
+        snapshot.m_bTruncated != (jobCount > JobStatusPage::MAX_JOBS))
+        return Report(false, scenario, "status page doesn't list the launched jobs");
+
+    // opening the fifo lets every waiting cat through and closing it gives them EOF,
+    // it's repeated for the ones that weren't waiting in open yet
+    const auto start = Clock::now();
+    const auto IsReaped = [](const JobStatusSnapshot &page) {
+        return page.m_Jobs.empty() && !page.m_bTruncated;
+    };
+    bool bReaped = false;
+    while (!bReaped && GetElapsedMs(start) < 60 * 1000)
+    {
+        int fd = open(fifoPath.c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd != -1)
+            close(fd);
+        bReaped = session.WaitForPage(IsReaped, 10, snapshot);
+    }
+    const double reapMs = GetElapsedMs(start);
+    unlink(fifoPath.c_str());
+    if (!bReaped)
+        return Report(false, scenario, std::to_string(snapshot.m_Jobs.size()) + " jobs left in the status page");
+
+    const size_t childCount = GetChildren(session.GetPID()).size();
+    if (childCount != 0)
+        return Report(false, scenario, std::to_string(childCount) + " children weren't reaped");
+
+    for (const auto &entry : snapshot.m_Finished)
+    {
+        if (static_cast<JobStatus>(entry.m_Status) != JobStatus::STATUS_EXITED || WEXITSTATUS(entry.m_ExitStatus) != 0)
+            return Report(false, scenario, "finished job " + std::to_string(entry.m_Pid) + " didn't exit cleanly");
+    }
+
+    session.Send("jobs\n");
+    if (!session.WaitForPrompt())
+        return Report(false, scenario, "no prompt after jobs");
+    const std::string jobsOutput = GetCommandOutput(session.GetLastOutput());
+    if (jobsOutput.find_first_not_of("\r\n") != std::string::npos)
+        return Report(false, scenario, "jobs still lists: " + jobsOutput);
+
+    char details[256];
+    snprintf(details, sizeof(details), "%d jobs reaped in %.1fms (%.0f jobs/s), launch %s", jobCount, reapMs,
+             jobCount / (reapMs / 1000.0), FormatLatency(launchLatencies).c_str());
+    return Report(true, scenario, details);
+}
+
+// launches sleep in the foreground and waits till it has been exec'd and owns the terminal
+bool LaunchForeground(ShellSession &session, pid_t &pid)
+{
+    session.Send("sleep 100\n");
+
+    JobStatusSnapshot snapshot;
+    const auto HasForegroundJob = [](const JobStatusSnapshot &page) {
+        return !page.m_Jobs.empty() && static_cast<ExecutionType>(page.m_Jobs.back().m_ExecType) == ExecutionType::FOREGROUND;
+    };
+    if (!session.WaitForPage(HasForegroundJob, PROMPT_TIMEOUT_MS, snapshot))
+        return false;
+    pid = snapshot.m_Jobs.back().m_Pid;
+
+    // a signal that arrives before exec would hit the handlers the child inherited from the shell
+    const auto start = Clock::now();
+    while (ReadComm(pid) != "sleep" || session.GetForegroundGroup() != pid)
+    {
+        if (GetElapsedMs(start) > PROMPT_TIMEOUT_MS)
+            return false;
+        session.Drain(1);
+    }
+    return true;
+}
+
+// stops a foreground job with CTRL + Z and brings it back with fg, over and over
+bool RunStopContinueCycles(ShellSession &session, int cycles)
+{
+    const char *scenario = "ctrl-z/fg cycles";
+    pid_t pid;
+    if (!LaunchForeground(session, pid))
+        return Report(false, scenario, "sleep didn't start in the foreground");
+
+    std::vector<double> stopLatencies, continueLatencies;
+    JobStatusSnapshot snapshot;
+    for (int cycle = 0; cycle < cycles; ++cycle)
+    {
+        auto start = Clock::now();
+        session.Send("\x1a");
+        if (!session.WaitForPrompt())
+            return Report(false, scenario, "no prompt after CTRL + Z in cycle " + std::to_string(cycle));
+        stopLatencies.push_back(GetElapsedMs(start));
+
+        char state;
+        pid_t parentPid;
+        if (!session.ReadPage(snapshot) || snapshot.m_Jobs.size() != 1 || snapshot.m_Jobs[0].m_Pid != pid ||
+            static_cast<JobStatus>(snapshot.m_Jobs[0].m_Status) != JobStatus::STATUS_STOPPED ||
+            !ReadProcStat(pid, state, parentPid) || state != 'T')
+            return Report(false, scenario, "job isn't listed as stopped in cycle " + std::to_string(cycle));
+
+        start = Clock::now();
+        session.Send("fg\n");
+        const auto IsRunning = [pid](const JobStatusSnapshot &page) {
+            return page.m_Jobs.size() == 1 && page.m_Jobs[0].m_Pid == pid &&
+                   static_cast<JobStatus>(page.m_Jobs[0].m_Status) == JobStatus::STATUS_RUNNING;
+        };
+        if (!session.WaitForPage(IsRunning, PROMPT_TIMEOUT_MS, snapshot) || session.GetForegroundGroup() != pid)
+            return Report(false, scenario, "job didn't get back to the foreground in cycle " + std::to_string(cycle));
+        continueLatencies.push_back(GetElapsedMs(start));
+
+        if (session.IsPromptPending())
+            return Report(false, scenario, "prompt printed while the job is in the foreground");
+    }
+
+    kill(pid, SIGKILL);
+    if (!session.WaitForPrompt())
+        return Report(false, scenario, "no prompt after the job got killed");
+
+    return Report(true, scenario, std::to_string(cycles) + " cycles, stop " + FormatLatency(stopLatencies) +
+                                      ", fg " + FormatLatency(continueLatencies));
+}
+
+// kills foreground jobs while the shell is waiting for them, with a background job finishing meanwhile
+bool RunForegroundKills(ShellSession &session, int cycles)
+{
+    const char *scenario = "kills in WaitForJob";
+    std::vector<double> latencies;
+    JobStatusSnapshot snapshot;
+    for (int cycle = 0; cycle < cycles; ++cycle)
+    {
+        session.Send("sleep 0.05 &\n");
+        if (!session.WaitForPrompt())
+            return Report(false, scenario, "no prompt after launching a background job");
+
+        pid_t pid;
+        if (!LaunchForeground(session, pid))
+            return Report(false, scenario, "sleep didn't start in the foreground");
+
+        // the background job must be reaped although the shell is busy waiting for the foreground one
+        const auto IsOnlyForeground = [pid](const JobStatusSnapshot &page) {
+            return page.m_Jobs.size() == 1 && page.m_Jobs[0].m_Pid == pid;
+        };
+        if (!session.WaitForPage(IsOnlyForeground, PROMPT_TIMEOUT_MS, snapshot))
+            return Report(false, scenario, "background job wasn't reaped while waiting in cycle " + std::to_string(cycle));
+
+        const auto start = Clock::now();
+        kill(pid, SIGKILL);
+        if (!session.WaitForPrompt())
+            return Report(false, scenario, "no prompt after kill in cycle " + std::to_string(cycle));
+        latencies.push_back(GetElapsedMs(start));
+
+        if (!session.ReadPage(snapshot) || !snapshot.m_Jobs.empty() || snapshot.m_Finished.empty())
+            return Report(false, scenario, "killed job is still listed in cycle " + std::to_string(cycle));
+        const JobStatusEntry &last = snapshot.m_Finished.back();
+        if (last.m_Pid != pid || static_cast<JobStatus>(last.m_Status) != JobStatus::STATUS_TERMINATED ||
+            WTERMSIG(last.m_ExitStatus) != SIGKILL)
+            return Report(false, scenario, "killed job wasn't recorded as terminated in cycle " + std::to_string(cycle));
+    }
+
+    if (!GetChildren(session.GetPID()).empty())
+        return Report(false, scenario, "children left unreaped");
+    return Report(true, scenario, std::to_string(cycles) + " kills, kill to prompt " + FormatLatency(latencies));
+}
+
+bool RunPromptLatency(ShellSession &session, int count)
+{
+    const char *scenario = "prompt latency";
+    std::vector<double> latencies;
+    for (int i = 0; i < count; ++i)
+    {
+        const auto start = Clock::now();
+        session.Send("\n");
+        if (!session.WaitForPrompt())
+            return Report(false, scenario, "no prompt after an empty line");
+        latencies.push_back(GetElapsedMs(start));
+    }
+    return Report(true, scenario, std::to_string(count) + " empty lines, " + FormatLatency(latencies));
+}
+
+bool ParseArgs(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool bHasValue = (i + 1 < argc);
+        if (strcmp(argv[i], "-n") == 0 && bHasValue)
+            options.m_BackgroundJobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && bHasValue)
+            options.m_Cycles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && bHasValue)
+            options.m_ShellPath = argv[++i];
+        else
+            return false;
+    }
+    return options.m_BackgroundJobs > 0 && options.m_Cycles > 0;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        fprintf(stderr, "usage: %s [-n background_jobs] [-c cycles] [-s cshell_path]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.m_ShellPath.empty())
+    {
+        // cshell is built next to us
+        const std::string self = argv[0];
+        const size_t slash = self.rfind('/');
+        options.m_ShellPath = (slash == std::string::npos ? "." : self.substr(0, slash)) + "/cshell";
+    }
+    char *resolvedPath = realpath(options.m_ShellPath.c_str(), nullptr);
+    if (!resolvedPath)
+    {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], options.m_ShellPath.c_str(), strerror(errno));
+        return EXIT_FAILURE;
+    }
+    options.m_ShellPath = resolvedPath;
+    free(resolvedPath);
+
+    char workDir[] = "/tmp/cshell-stress.XXXXXX";
+    if (!mkdtemp(workDir))
+    {
+        perror(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool bPassed;
+    {
+        ShellSession session;
+        bPassed = session.Start(options.m_ShellPath, workDir) || Report(false, "startup", "no prompt from " + options.m_ShellPath);
+        bPassed = bPassed && RunBackgroundExits(session, workDir, options.m_BackgroundJobs);
+        bPassed = bPassed && RunStopContinueCycles(session, options.m_Cycles);
+        bPassed = bPassed && RunForegroundKills(session, options.m_Cycles);
+        bPassed = bPassed && RunPromptLatency(session, 1000);
+
+        if (bPassed)
+        {
+            const pid_t shellPid = session.GetPID();
+            JobStatusSnapshot snapshot;
+            bPassed = (session.Exit() || Report(false, "exit", "shell didn't exit")) &&
+                      (!JobStatusPage::Read(JobStatusPage::GetName(shellPid), snapshot) ||
+                       Report(false, "exit", "status page wasn't removed"));
+        }
+    }
+
+    RemoveDirectory(workDir);
+    return bPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
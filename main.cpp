@@ -5,6 +5,19 @@ Shell gShell; // gShell is created singleton so that we can use it inside signal
 
 int main(int argc, char *argv[])
 {
+    bool bProfileStartup = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--startup-profile") == 0)
+            bProfileStartup = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--startup-profile]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    gShell.Init(bProfileStartup);
     gShell.Run(); // keeps running in a loop till it receives an exit command
     return EXIT_SUCCESS;
 }